@@ -0,0 +1,1027 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "customallocator.h"
+#include "customvector.h"
+#include "staticpool.h"
+#include "heapcount.h"
+
+#ifdef BLOCKSOURCE_HAS_MMAP
+#include <sys/resource.h>
+#endif
+
+// Сравнение конфигураций аллокатора на стандартных контейнерах и на
+// сценариях, под которые делались отдельные части пула.
+// JSON: allocator_bench --benchmark_out=<file> --benchmark_out_format=json
+// или цель allocator_bench_json.
+
+namespace {
+
+// Элемент заданного размера с целым ключом
+template <std::size_t Size>
+struct Item {
+    static_assert(Size >= sizeof(int), "item must hold its key");
+
+    explicit Item(int k = 0) noexcept : key(k) {}
+
+    int key;
+    char payload[Size - sizeof(int)] = {};
+
+    bool operator<(const Item& other) const noexcept { return key < other.key; }
+    bool operator==(const Item& other) const noexcept { return key == other.key; }
+};
+
+// Конфигурации аллокатора
+struct StdConfig {
+    template <typename T> using alloc = std::allocator<T>;
+    static constexpr const char* name = "std";
+};
+
+struct PoolConfig {
+    template <typename T> using alloc = CustomAllocator<T, 1024>;
+    static constexpr const char* name = "pool";
+};
+
+struct FreeConfig {
+    template <typename T> using alloc = CustomAllocator<T, 1024, true, true>;
+    static constexpr const char* name = "pool-free";
+};
+
+// Один блок на весь контейнер; только для узловых контейнеров
+struct FixedConfig {
+    template <typename T> using alloc = CustomAllocator<T, (1 << 17), false, true>;
+    static constexpr const char* name = "pool-fixed";
+};
+
+template <typename Config, std::size_t Size>
+using MapOf = std::map<int, Item<Size>, std::less<int>,
+                       typename Config::template alloc<std::pair<const int, Item<Size>>>>;
+
+template <typename Config, std::size_t Size>
+using SetOf = std::set<Item<Size>, std::less<Item<Size>>,
+                       typename Config::template alloc<Item<Size>>>;
+
+template <typename Config, std::size_t Size>
+using ListOf = std::list<Item<Size>, typename Config::template alloc<Item<Size>>>;
+
+template <typename Config, std::size_t Size>
+using UnorderedMapOf = std::unordered_map<int, Item<Size>, std::hash<int>, std::equal_to<int>,
+                                          typename Config::template alloc<std::pair<const int, Item<Size>>>>;
+
+template <typename Config, std::size_t Size>
+using VectorOf = SimpleVector<Item<Size>, typename Config::template alloc<Item<Size>>>;
+
+// Операции над контейнером по ключу; erase без find удаляет любой элемент
+struct MapOps {
+    template <typename C> static void insert(C& c, int k) { c.emplace(k, typename C::mapped_type(k)); }
+    template <typename C> static bool find(const C& c, int k) { return c.find(k) != c.end(); }
+    template <typename C> static void erase(C& c, int k) { c.erase(k); }
+    template <typename C> static long sum(const C& c) {
+        long s = 0;
+        for (const auto& kv : c) s += kv.second.key;
+        return s;
+    }
+};
+
+struct SetOps {
+    template <typename C> static void insert(C& c, int k) { c.emplace(k); }
+    template <typename C> static bool find(const C& c, int k) { return c.find(typename C::key_type(k)) != c.end(); }
+    template <typename C> static void erase(C& c, int k) { c.erase(typename C::key_type(k)); }
+    template <typename C> static long sum(const C& c) {
+        long s = 0;
+        for (const auto& item : c) s += item.key;
+        return s;
+    }
+};
+
+struct ListOps {
+    static constexpr bool has_find = false;
+    template <typename C> static void insert(C& c, int k) { c.emplace_back(k); }
+    template <typename C> static void erase(C& c, int) { c.pop_front(); }
+    template <typename C> static long sum(const C& c) {
+        long s = 0;
+        for (const auto& item : c) s += item.key;
+        return s;
+    }
+};
+
+struct VectorOps {
+    template <typename C> static void insert(C& c, int k) { c.EmplaceBack(k); }
+    template <typename C> static bool find(const C& c, int k) { return c[static_cast<std::size_t>(k)].key == k; }
+    template <typename C> static void erase(C& c, int) { c.PopBack(); }
+    template <typename C> static long sum(const C& c) {
+        long s = 0;
+        for (const auto& item : c) s += item.key;
+        return s;
+    }
+};
+
+template <typename Ops, typename = void>
+struct has_find : std::true_type {};
+
+template <typename Ops>
+struct has_find<Ops, std::void_t<decltype(Ops::has_find)>> : std::bool_constant<Ops::has_find> {};
+
+// Перестановка 0..n-1 с фиксированным seed
+const std::vector<int>& keys(std::size_t n) {
+    static std::map<std::size_t, std::vector<int>> cache;
+    auto& k = cache[n];
+    if (k.empty()) {
+        k.resize(n);
+        std::iota(k.begin(), k.end(), 0);
+        std::shuffle(k.begin(), k.end(), std::mt19937(42));
+    }
+    return k;
+}
+
+// Вектор заполняется по порядку: find обращается по индексу
+template <typename Ops>
+const std::vector<int>& insert_order(std::size_t n) {
+    if constexpr (std::is_same_v<Ops, VectorOps> || std::is_same_v<Ops, ListOps>) {
+        static std::map<std::size_t, std::vector<int>> cache;
+        auto& k = cache[n];
+        if (k.empty()) {
+            k.resize(n);
+            std::iota(k.begin(), k.end(), 0);
+        }
+        return k;
+    } else {
+        return keys(n);
+    }
+}
+
+template <typename C, typename Ops>
+void fill(C& c, std::size_t n) {
+    for (int k : insert_order<Ops>(n)) Ops::insert(c, k);
+}
+
+template <typename C, typename Ops>
+void BM_Insert(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    for (auto _ : state) {
+        C c;
+        fill<C, Ops>(c, n);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+template <typename C, typename Ops>
+void BM_Lookup(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    C c;
+    fill<C, Ops>(c, n);
+    const auto& k = keys(n);
+    for (auto _ : state) {
+        for (int key : k) benchmark::DoNotOptimize(Ops::find(c, key));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+template <typename C, typename Ops>
+void BM_Erase(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto c = std::make_unique<C>();
+        fill<C, Ops>(*c, n);
+        state.ResumeTiming();
+        for (int key : k) Ops::erase(*c, key);
+        state.PauseTiming();
+        c.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+template <typename C, typename Ops>
+void BM_Iterate(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    C c;
+    fill<C, Ops>(c, n);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Ops::sum(c));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+template <typename C, typename Ops>
+void register_container(const std::string& container, const char* config, std::size_t size) {
+    std::string suffix = "/" + std::string(config) + "/" + std::to_string(size);
+    auto range = [](benchmark::internal::Benchmark* b) {
+        b->RangeMultiplier(8)->Range(1 << 10, 1 << 16);
+    };
+    range(benchmark::RegisterBenchmark((container + "/insert" + suffix).c_str(), BM_Insert<C, Ops>));
+    if constexpr (has_find<Ops>::value) {
+        range(benchmark::RegisterBenchmark((container + "/lookup" + suffix).c_str(), BM_Lookup<C, Ops>));
+    }
+    range(benchmark::RegisterBenchmark((container + "/erase" + suffix).c_str(), BM_Erase<C, Ops>));
+    range(benchmark::RegisterBenchmark((container + "/iterate" + suffix).c_str(), BM_Iterate<C, Ops>));
+}
+
+template <typename Config, std::size_t Size>
+void register_node_containers() {
+    register_container<MapOf<Config, Size>, MapOps>("map", Config::name, Size);
+    register_container<SetOf<Config, Size>, SetOps>("set", Config::name, Size);
+    register_container<ListOf<Config, Size>, ListOps>("list", Config::name, Size);
+}
+
+template <typename Config, std::size_t Size>
+void register_all_containers() {
+    register_node_containers<Config, Size>();
+    register_container<UnorderedMapOf<Config, Size>, MapOps>("unordered_map", Config::name, Size);
+    register_container<VectorOf<Config, Size>, VectorOps>("vector", Config::name, Size);
+}
+
+template <std::size_t Size>
+void register_containers() {
+    register_all_containers<StdConfig, Size>();
+    register_all_containers<PoolConfig, Size>();
+    register_all_containers<FreeConfig, Size>();
+    register_node_containers<FixedConfig, Size>();
+}
+
+// Память, которую пул аллокатора взял у источника, в КиБ: блоки арены,
+// slab'ы и крупные блоки вместе
+template <typename Alloc>
+double reserved_kb(const Alloc& alloc) {
+    return static_cast<double>(alloc.pool()->reserved_bytes) / 1024;
+}
+
+// Вектор, который многократно растет и освобождается в одном пуле:
+// освобожденные span'ы переиспользуются, занятая пулом память выходит на плато
+template <typename Alloc>
+void BM_VectorGrowShrink(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    Alloc alloc;
+    double reserved = 0;
+    for (auto _ : state) {
+        SimpleVector<int, Alloc> v(alloc);
+        for (std::size_t i = 0; i < n; ++i) v.PushBack(static_cast<int>(i));
+        benchmark::DoNotOptimize(v.begin());
+        if constexpr (!std::is_same_v<Alloc, std::allocator<int>>) {
+            reserved = std::max(reserved, reserved_kb(alloc));
+        }
+    }
+    if constexpr (!std::is_same_v<Alloc, std::allocator<int>>) {
+        state.counters["reserved_kb"] = reserved;
+    }
+}
+
+// Два вектора растут вперемешку (второй вдвое медленнее) и освобождаются,
+// и так каждую итерацию: буферы уходят в корзины span'ов, и следующие
+// итерации собираются из них. growth_kb - прирост памяти пула после
+// двух первых итераций, на плато он нулевой. Без PerElementFree первый буфер
+// вектора из одного элемента не возвращается, и пул медленно растет
+template <typename Alloc>
+void BM_VectorSteadyState(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    Alloc alloc;
+    double warm = -1;
+    int round = 0;
+    for (auto _ : state) {
+        {
+            SimpleVector<int, Alloc> a(alloc);
+            SimpleVector<int, Alloc> b(alloc);
+            for (std::size_t i = 0; i < n; ++i) {
+                a.PushBack(static_cast<int>(i));
+                if (i % 2 == 0) b.PushBack(static_cast<int>(i));
+            }
+            benchmark::DoNotOptimize(a.begin());
+            benchmark::DoNotOptimize(b.begin());
+        }
+        if (++round == 2) warm = reserved_kb(alloc);
+    }
+    state.counters["reserved_kb"] = reserved_kb(alloc);
+    state.counters["growth_kb"] = reserved_kb(alloc) - warm;
+}
+
+// Владение пулом, как до перехода на обычный указатель: аллокатор
+// хранит shared_ptr на handle с shared_ptr на пул, и каждое обращение к
+// пулу копирует внутренний shared_ptr - двойная косвенность и пара
+// атомарных операций на каждое выделение и освобождение. Только для
+// сравнения в map_churn/pool-free-copy-ptr
+struct CopyPerCallOwnership {
+    template <typename State>
+    class holder {
+    public:
+        template <typename... Args>
+        static holder make(Args&&... args) {
+            holder h;
+            h.handle_ = std::make_shared<Handle>();
+            h.handle_->state = std::make_shared<State>(std::forward<Args>(args)...);
+            return h;
+        }
+
+        State* get() const noexcept {
+            if (!handle_) return nullptr;
+            std::shared_ptr<State> state = handle_->state;
+            return state.get();
+        }
+
+    private:
+        struct Handle {
+            std::shared_ptr<State> state;
+        };
+
+        std::shared_ptr<Handle> handle_;
+    };
+};
+
+// Вставка и удаление в долгоживущем map: узлы возвращаются в пул
+template <typename Alloc>
+void BM_MapChurn(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    std::size_t heap = 0;
+    std::map<int, int, std::less<int>, Alloc> m;
+    for (auto _ : state) {
+        std::size_t before = heap_allocations;
+        for (int key : k) m.emplace(key, key);
+        for (int key : k) m.erase(key);
+        heap += heap_allocations - before;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n) * 2);
+    state.counters["heap_allocs"] = static_cast<double>(heap);
+    if constexpr (!std::is_same_v<Alloc, std::allocator<std::pair<const int, int>>>) {
+        state.counters["reserved_kb"] = reserved_kb(m.get_allocator());
+    }
+}
+
+// Свободный список на std::vector<void*>, как в пуле до перехода на
+// интрусивный: сам список растет в куче и добавляет запись на каждый free
+struct VectorFreeList {
+    void push(void* p) { slots.push_back(p); }
+
+    void* pop() noexcept {
+        if (slots.empty()) return nullptr;
+        void* p = slots.back();
+        slots.pop_back();
+        return p;
+    }
+
+    std::vector<void*> slots;
+};
+
+// Минимальный пул одиночных слотов по 64 байта: bump по блокам и
+// свободный список FreeList. Отличается между вариантами только список
+template <typename FreeList>
+struct SlotArena {
+    static constexpr std::size_t slot = 64;
+    static constexpr std::size_t block_slots = 1024;
+
+    SlotArena() = default;
+    SlotArena(const SlotArena&) = delete;
+    SlotArena& operator=(const SlotArena&) = delete;
+
+    ~SlotArena() {
+        for (void* b : blocks) ::operator delete(b);
+    }
+
+    void* allocate() {
+        if (void* p = free.pop()) return p;
+        if (next == end) {
+            next = static_cast<char*>(::operator new(slot * block_slots));
+            blocks.push_back(next);
+            end = next + slot * block_slots;
+        }
+        void* p = next;
+        next += slot;
+        return p;
+    }
+
+    void deallocate(void* p) { free.push(p); }
+
+    FreeList free;
+    std::vector<void*> blocks;
+    char* next = nullptr;
+    char* end = nullptr;
+};
+
+template <typename T, typename FreeList>
+struct SlotAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = SlotAllocator<U, FreeList>;
+    };
+
+    SlotAllocator() : arena(std::make_shared<SlotArena<FreeList>>()) {}
+
+    template <typename U>
+    SlotAllocator(const SlotAllocator<U, FreeList>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        if (n != 1 || sizeof(T) > SlotArena<FreeList>::slot) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(arena->allocate());
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        if (n != 1 || sizeof(T) > SlotArena<FreeList>::slot) {
+            ::operator delete(p);
+            return;
+        }
+        arena->deallocate(p);
+    }
+
+    template <typename U>
+    bool operator==(const SlotAllocator<U, FreeList>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const SlotAllocator<U, FreeList>& other) const noexcept { return arena != other.arena; }
+
+    std::shared_ptr<SlotArena<FreeList>> arena;
+};
+
+// Свободный список на векторе против интрусивного на одинаковом churn
+// std::map и std::list: вставить n элементов, затем удалить все
+template <typename FreeList>
+void BM_FreeListChurn(benchmark::State& state) {
+    using MapAlloc = SlotAllocator<std::pair<const int, int>, FreeList>;
+    using ListAlloc = SlotAllocator<int, FreeList>;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    std::size_t heap = 0;
+    std::map<int, int, std::less<int>, MapAlloc> m;
+    std::list<int, ListAlloc> l;
+    for (auto _ : state) {
+        std::size_t before = heap_allocations;
+        for (int key : k) {
+            m.emplace(key, key);
+            l.push_back(key);
+        }
+        for (int key : k) {
+            m.erase(key);
+            l.pop_front();
+        }
+        heap += heap_allocations - before;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n) * 4);
+    state.counters["heap_allocs"] = static_cast<double>(heap);
+}
+
+// map_churn на StaticPool: пул и его память - в статическом объекте,
+// heap_allocs (вместе с созданием map) должен остаться нулевым
+template <std::size_t Bytes>
+void BM_StaticPoolChurn(benchmark::State& state) {
+    using Pool = StaticPool<std::pair<const int, int>, Bytes, true>;
+    static Pool pool;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    std::size_t heap = heap_allocations;
+    std::map<int, int, std::less<int>, typename Pool::allocator_type> m(pool.allocator());
+    heap = heap_allocations - heap;
+    for (auto _ : state) {
+        std::size_t before = heap_allocations;
+        for (int key : k) m.emplace(key, key);
+        for (int key : k) m.erase(key);
+        heap += heap_allocations - before;
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n) * 2);
+    state.counters["heap_allocs"] = static_cast<double>(heap);
+}
+
+// Один обычный пул под общим mutex: базовая линия для ThreadSafe-пула
+template <typename T, typename Inner = CustomAllocator<T, 1024, true, true>>
+struct MutexGuarded {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = MutexGuarded<U, typename std::allocator_traits<Inner>::template rebind_alloc<U>>;
+    };
+
+    MutexGuarded() : guard(std::make_shared<std::mutex>()) {}
+
+    template <typename U, typename Other>
+    MutexGuarded(const MutexGuarded<U, Other>& other) noexcept : inner(other.inner), guard(other.guard) {}
+
+    T* allocate(std::size_t n) {
+        std::lock_guard<std::mutex> lock(*guard);
+        return inner.allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        std::lock_guard<std::mutex> lock(*guard);
+        inner.deallocate(p, n);
+    }
+
+    template <typename U, typename Other>
+    bool operator==(const MutexGuarded<U, Other>& other) const noexcept { return guard == other.guard; }
+    template <typename U, typename Other>
+    bool operator!=(const MutexGuarded<U, Other>& other) const noexcept { return guard != other.guard; }
+
+    Inner inner;
+    std::shared_ptr<std::mutex> guard;
+};
+
+// Масштабирование по потокам: у каждого потока свой список в общем пуле
+template <typename Alloc>
+void BM_ThreadedList(benchmark::State& state) {
+    static Alloc shared;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    for (auto _ : state) {
+        std::list<int, Alloc> l(shared);
+        for (std::size_t i = 0; i < n; ++i) l.push_back(static_cast<int>(i));
+        while (!l.empty()) l.pop_front();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+// Свободный список под mutex: то, что заменил TaggedFreeStack
+struct MutexFreeList {
+    void push(void* p) {
+        std::lock_guard<std::mutex> lock(mutex);
+        list.push(p);
+    }
+
+    void* pop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return list.pop();
+    }
+
+    std::mutex mutex;
+    IntrusiveFreeList list;
+};
+
+// Конкуренция за один свободный список: каждый поток снимает слот и
+// возвращает его обратно. Число потоков задает ThreadRange
+template <typename FreeList>
+void BM_FreeListContention(benchmark::State& state) {
+    static constexpr std::size_t slots = 1024;
+    static FreeList list;
+    static std::vector<std::uint64_t> storage(slots * 2);
+    if (state.thread_index() == 0) {
+        while (list.pop()) {
+        }
+        for (std::size_t i = 0; i < slots; ++i) list.push(&storage[i * 2]);
+    }
+    for (auto _ : state) {
+        void* p = list.pop();
+        benchmark::DoNotOptimize(p);
+        if (p) list.push(p);
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+// Элемент на один AVX-регистр: восемь float, выравнивание 32 байта
+struct alignas(32) WideItem {
+    explicit WideItem(int k = 0) noexcept {
+        for (float& x : lane) x = static_cast<float>(k);
+    }
+
+    float lane[8];
+};
+
+// Сумма элемента выровненными загрузками: при невыровненном узле
+// _mm256_load_ps / _mm_load_ps падают, а не молча замедляются
+float wide_sum(const WideItem& item) noexcept {
+#if defined(__AVX__)
+    __m256 v = _mm256_load_ps(item.lane);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+#elif defined(__SSE2__)
+    __m128 s = _mm_add_ps(_mm_load_ps(item.lane), _mm_load_ps(item.lane + 4));
+#else
+    float s4[4];
+    for (int i = 0; i < 4; ++i) s4[i] = item.lane[i] + item.lane[i + 4];
+    return s4[0] + s4[1] + s4[2] + s4[3];
+#endif
+#if defined(__AVX__) || defined(__SSE2__)
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+#endif
+}
+
+// Обход узлов с элементом шириной в AVX-регистр (alignof 32)
+template <typename Alloc>
+void BM_AlignedIterate(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    std::list<WideItem, Alloc> l;
+    for (std::size_t i = 0; i < n; ++i) l.emplace_back(static_cast<int>(i));
+    for (auto _ : state) {
+        float s = 0;
+        for (const auto& item : l) s += wide_sum(item);
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+// Страничные промахи процесса с начала работы: minor и major.
+// Нули, если узнать их негде
+struct PageFaults {
+    double minor = 0;
+    double major = 0;
+};
+
+PageFaults page_faults() {
+    PageFaults f;
+#ifdef BLOCKSOURCE_HAS_MMAP
+    rusage usage{};
+    if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+        f.minor = static_cast<double>(usage.ru_minflt);
+        f.major = static_cast<double>(usage.ru_majflt);
+    }
+#endif
+    return f;
+}
+
+// Построение большого map: источник блоков и политика роста.
+// minflt/majflt - страничные промахи на одно построение, spans - остатки
+// блоков в корзинах пула после построения
+template <typename Alloc, typename Key = int>
+void BM_MapBuild(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    std::size_t blocks = 0;
+    std::size_t spans = 0;
+    double reserved = 0;
+    PageFaults start = page_faults();
+    for (auto _ : state) {
+        std::map<Key, Key, std::less<Key>, Alloc> m;
+        for (int key : k) m.emplace(key, key);
+        blocks = m.get_allocator().pool()->block_count;
+        spans = m.get_allocator().pool()->span_count;
+        reserved = reserved_kb(m.get_allocator());
+        benchmark::DoNotOptimize(m);
+    }
+    PageFaults end = page_faults();
+    double runs = static_cast<double>(state.iterations());
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    state.counters["blocks"] = static_cast<double>(blocks);
+    state.counters["spans"] = static_cast<double>(spans);
+    state.counters["reserved_kb"] = reserved;
+    state.counters["minflt"] = (end.minor - start.minor) / runs;
+    state.counters["majflt"] = (end.major - start.major) / runs;
+}
+
+// Обход большого map, построенного вне замера в случайном порядке ключей:
+// соседние по ключу узлы разбросаны по блокам, и обход упирается в TLB
+// и промахи кэша. Сравнивать с map_build на тех же конфигурациях
+template <typename Alloc, typename Key = int>
+void BM_MapIterate(benchmark::State& state) {
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    std::map<Key, Key, std::less<Key>, Alloc> m;
+    for (int key : k) m.emplace(key, key);
+    for (auto _ : state) {
+        Key sum = 0;
+        for (const auto& kv : m) sum += kv.second;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+// Построение и обход большого map на одной конфигурации
+template <typename Alloc, typename Key = int>
+void register_map_build(const std::string& name) {
+    auto large = [](benchmark::internal::Benchmark* b) {
+        b->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+    };
+    if constexpr (!std::is_same_v<Alloc, std::allocator<std::pair<const Key, Key>>>) {
+        large(benchmark::RegisterBenchmark(("map_build/" + name).c_str(), BM_MapBuild<Alloc, Key>));
+    }
+    large(benchmark::RegisterBenchmark(("map_iterate/" + name).c_str(), BM_MapIterate<Alloc, Key>));
+}
+
+// Обработчик запроса: временные map и вектор на каждый запрос.
+// Reset = false - новый аллокатор (и пул) на запрос, true - один пул и reset()
+template <typename Alloc, bool Reset>
+void BM_PerRequest(benchmark::State& state) {
+    using IntAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    Alloc shared;
+    for (auto _ : state) {
+        Alloc alloc = Reset ? shared : Alloc();
+        {
+            std::map<int, int, std::less<int>, Alloc> m(alloc);
+            SimpleVector<int, IntAlloc> v{IntAlloc(alloc)};
+            for (int key : k) {
+                m.emplace(key, key);
+                v.PushBack(key);
+            }
+            benchmark::DoNotOptimize(m);
+            benchmark::DoNotOptimize(v.begin());
+        }
+        if constexpr (Reset) {
+            alloc.reset();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+}
+
+// Один тип аллокатора на вектор и узлы map: перевыделения растущего
+// вектора крупнее блока не должны сбивать bump-выделение узлов
+template <typename Alloc>
+void BM_MixedVectorMap(benchmark::State& state) {
+    using IntAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
+    std::size_t n = static_cast<std::size_t>(state.range(0));
+    const auto& k = keys(n);
+    double reserved = 0;
+    for (auto _ : state) {
+        Alloc alloc;
+        std::map<int, int, std::less<int>, Alloc> m(alloc);
+        SimpleVector<int, IntAlloc> v{IntAlloc(alloc)};
+        for (int key : k) {
+            v.PushBack(key);
+            m.emplace(key, key);
+        }
+        benchmark::DoNotOptimize(m);
+        benchmark::DoNotOptimize(v.begin());
+        if constexpr (!std::is_same_v<Alloc, std::allocator<std::pair<const int, int>>>) {
+            reserved = reserved_kb(alloc);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(n));
+    state.counters["reserved_kb"] = reserved;
+}
+
+// Поиск блока по указателю (PoolState::owns) в пуле из range(0) блоков
+template <typename Alloc>
+void BM_OwnsLookup(benchmark::State& state) {
+    using T = typename Alloc::value_type;
+    std::size_t blocks = static_cast<std::size_t>(state.range(0));
+    Alloc alloc;
+    std::vector<T*> ptrs;
+    while (alloc.pool()->block_count < blocks) {
+        ptrs.push_back(alloc.allocate(1));
+    }
+    const auto& order = keys(ptrs.size());
+    for (auto _ : state) {
+        std::size_t hits = 0;
+        for (int i : order) hits += alloc.pool()->owns(ptrs[static_cast<std::size_t>(i)]);
+        benchmark::DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(ptrs.size()));
+    for (T* p : ptrs) alloc.deallocate(p, 1);
+}
+
+// Резидентная память процесса; 0, если узнать ее негде
+std::size_t resident_bytes() {
+#ifdef BLOCKSOURCE_HAS_MMAP
+    std::FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0;
+    int read = std::fscanf(f, "%lu %lu", &size, &resident);
+    std::fclose(f);
+    return read == 2 ? resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+// Всплеск и простой: map вырастает до n узлов, затем остается 1% самых
+// новых. Счетчики - прирост RSS процесса на пике и после спада
+template <typename Alloc>
+void BM_SpikeIdle(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    double peak = 0;
+    double idle = 0;
+    for (auto _ : state) {
+        double base = static_cast<double>(resident_bytes());
+        std::map<int, int, std::less<int>, Alloc> m;
+        for (int i = 0; i < n; ++i) m.emplace(i, i);
+        peak = static_cast<double>(resident_bytes()) - base;
+        for (int i = 0; i < n - n / 100; ++i) m.erase(i);
+        idle = static_cast<double>(resident_bytes()) - base;
+        benchmark::DoNotOptimize(m);
+    }
+    state.counters["rss_peak_kb"] = peak / 1024;
+    state.counters["rss_idle_kb"] = idle / 1024;
+}
+
+// Пул между запросами переиспользуется через reset(): после запроса на
+// n узлов идут обычные, в 100 раз меньше. Trim - после reset() вернуть
+// простаивающие блоки сверх нужных обычному запросу. Счетчики - прирост
+// RSS на пике и во время обычных запросов относительно RSS с пустым
+// пулом; блоки берутся из mmap, чтобы не зависеть от кучи прошлых тестов
+template <typename Alloc, bool Trim, TrimMode Mode = TrimMode::Release>
+void BM_SpikeReset(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    double peak = 0;
+    double idle = 0;
+    double trimmed = 0;
+    for (auto _ : state) {
+        Alloc alloc;
+        double base = static_cast<double>(resident_bytes());
+        for (int size : {n, n / 100, n / 100}) {
+            {
+                std::map<int, int, std::less<int>, Alloc> m(alloc);
+                for (int i = 0; i < size; ++i) m.emplace(i, i);
+                benchmark::DoNotOptimize(m);
+            }
+            if (size == n) peak = static_cast<double>(resident_bytes()) - base;
+            alloc.reset();
+            if constexpr (Trim) {
+                std::size_t keep = alloc.pool()->largest_slot * static_cast<std::size_t>(n / 100);
+                trimmed += static_cast<double>(alloc.trim(keep, Mode));
+            }
+        }
+        idle = static_cast<double>(resident_bytes()) - base;
+    }
+    state.counters["rss_peak_kb"] = peak / 1024;
+    state.counters["rss_idle_kb"] = idle / 1024;
+    state.counters["trimmed_kb"] = trimmed / 1024;
+}
+
+// Рекурсивный разбор: на каждом уровне временные вектор и map.
+// Scoped = true - уровень живет в PoolScope и откатывается целиком
+template <typename Alloc, bool Scoped>
+long nested_level(const Alloc& alloc, int depth, int width);
+
+template <typename Alloc, bool Scoped>
+long nested_body(const Alloc& alloc, int depth, int width) {
+    using IntAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<const int, int>>;
+
+    SimpleVector<int, IntAlloc> v{IntAlloc(alloc)};
+    std::map<int, int, std::less<int>, NodeAlloc> m{NodeAlloc(alloc)};
+    for (int i = 0; i < width; ++i) {
+        v.PushBack(i);
+        m.emplace(i, depth);
+    }
+    long sum = 0;
+    if (depth > 0) {
+        sum += nested_level<Alloc, Scoped>(alloc, depth - 1, width);
+    }
+    for (int x : v) sum += x;
+    return sum + static_cast<long>(m.size());
+}
+
+template <typename Alloc, bool Scoped>
+long nested_level(const Alloc& alloc, int depth, int width) {
+    if constexpr (Scoped) {
+        PoolScope<Alloc> scope(alloc);
+        return nested_body<Alloc, Scoped>(alloc, depth, width);
+    } else {
+        return nested_body<Alloc, Scoped>(alloc, depth, width);
+    }
+}
+
+template <typename Alloc, bool Scoped>
+void BM_NestedScopes(benchmark::State& state) {
+    int width = static_cast<int>(state.range(0));
+    constexpr int depth = 8;
+    Alloc alloc;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(nested_level<Alloc, Scoped>(alloc, depth, width));
+    }
+    state.SetItemsProcessed(state.iterations() * (depth + 1) * width);
+}
+
+using MapNode = std::pair<const int, int>;
+
+void register_pool_benchmarks() {
+    auto sizes = [](benchmark::internal::Benchmark* b) {
+        b->RangeMultiplier(8)->Range(1 << 10, 1 << 16);
+    };
+
+    sizes(benchmark::RegisterBenchmark("vector_grow_shrink/std", BM_VectorGrowShrink<std::allocator<int>>));
+    sizes(benchmark::RegisterBenchmark("vector_grow_shrink/pool",
+                                       BM_VectorGrowShrink<CustomAllocator<int, 1024>>));
+
+    sizes(benchmark::RegisterBenchmark("vector_steady_state/pool", BM_VectorSteadyState<CustomAllocator<int, 1024>>));
+    sizes(benchmark::RegisterBenchmark("vector_steady_state/pool-free",
+                                       BM_VectorSteadyState<CustomAllocator<int, 1024, true, true>>));
+    sizes(benchmark::RegisterBenchmark("map_churn/std", BM_MapChurn<std::allocator<MapNode>>));
+    sizes(benchmark::RegisterBenchmark("map_churn/pool", BM_MapChurn<CustomAllocator<MapNode, 1024>>));
+    sizes(benchmark::RegisterBenchmark("map_churn/pool-free",
+                                       BM_MapChurn<CustomAllocator<MapNode, 1024, true, true>>));
+    sizes(benchmark::RegisterBenchmark(
+        "map_churn/slab",
+        BM_MapChurn<CustomAllocator<MapNode, 1024, true, true, false, NaturalAlign, NewBlockSource,
+                                    SharedOwnership, FixedGrowth, BitmapSlabs<>>>));
+    sizes(benchmark::RegisterBenchmark(
+        "map_churn/pool-free-local",
+        BM_MapChurn<CustomAllocator<MapNode, 1024, true, true, false, NaturalAlign, NewBlockSource,
+                                    LocalOwnership>>));
+    sizes(benchmark::RegisterBenchmark(
+        "map_churn/pool-free-copy-ptr",
+        BM_MapChurn<CustomAllocator<MapNode, 1024, true, true, false, NaturalAlign, NewBlockSource,
+                                    CopyPerCallOwnership>>));
+    sizes(benchmark::RegisterBenchmark("map_churn/static-pool", BM_StaticPoolChurn<(std::size_t(4) << 20)>));
+
+    sizes(benchmark::RegisterBenchmark("free_list_churn/vector", BM_FreeListChurn<VectorFreeList>));
+    sizes(benchmark::RegisterBenchmark("free_list_churn/intrusive", BM_FreeListChurn<IntrusiveFreeList>));
+
+    using RequestAlloc = CustomAllocator<MapNode, 1024, true, true>;
+    sizes(benchmark::RegisterBenchmark("per_request/std", BM_PerRequest<std::allocator<MapNode>, false>));
+    sizes(benchmark::RegisterBenchmark("per_request/recreate", BM_PerRequest<RequestAlloc, false>));
+    sizes(benchmark::RegisterBenchmark("per_request/reset", BM_PerRequest<RequestAlloc, true>));
+
+    sizes(benchmark::RegisterBenchmark("mixed_vector_map/std", BM_MixedVectorMap<std::allocator<MapNode>>));
+    sizes(benchmark::RegisterBenchmark("mixed_vector_map/pool", BM_MixedVectorMap<CustomAllocator<MapNode, 64>>));
+    sizes(benchmark::RegisterBenchmark("mixed_vector_map/pool-free",
+                                       BM_MixedVectorMap<CustomAllocator<MapNode, 64, true, true>>));
+
+    benchmark::RegisterBenchmark("owns_lookup/pool", BM_OwnsLookup<CustomAllocator<MapNode, 64>>)
+        ->RangeMultiplier(16)->Range(16, 1 << 14);
+
+#ifdef BLOCKSOURCE_HAS_MMAP
+    auto spike = [](benchmark::internal::Benchmark* b) {
+        b->Arg(1 << 20)->Iterations(1)->Unit(benchmark::kMillisecond);
+    };
+    spike(benchmark::RegisterBenchmark("spike_idle/std", BM_SpikeIdle<std::allocator<MapNode>>));
+    spike(benchmark::RegisterBenchmark(
+        "spike_idle/pool-free",
+        BM_SpikeIdle<CustomAllocator<MapNode, 1024, true, true, false, NaturalAlign, MmapBlockSource<>>>));
+    spike(benchmark::RegisterBenchmark(
+        "spike_idle/slab",
+        BM_SpikeIdle<CustomAllocator<MapNode, 1024, true, true, false, NaturalAlign, MmapBlockSource<>,
+                                     SharedOwnership, FixedGrowth, BitmapSlabs<>>>));
+
+    using SpikeAlloc = CustomAllocator<MapNode, 1024, true, false, false, NaturalAlign, MmapBlockSource<>>;
+    spike(benchmark::RegisterBenchmark("spike_reset/pool", BM_SpikeReset<SpikeAlloc, false>));
+    spike(benchmark::RegisterBenchmark("spike_reset/pool-trim", BM_SpikeReset<SpikeAlloc, true>));
+    spike(benchmark::RegisterBenchmark("spike_reset/pool-purge", BM_SpikeReset<SpikeAlloc, true, TrimMode::Purge>));
+#endif
+
+    auto widths = [](benchmark::internal::Benchmark* b) {
+        b->RangeMultiplier(8)->Range(16, 1 << 12);
+    };
+    widths(benchmark::RegisterBenchmark("nested_scopes/std", BM_NestedScopes<std::allocator<int>, false>));
+    widths(benchmark::RegisterBenchmark("nested_scopes/pool-free",
+                                        BM_NestedScopes<CustomAllocator<int, 1024, true, true>, false>));
+    widths(benchmark::RegisterBenchmark("nested_scopes/pool-scope",
+                                        BM_NestedScopes<CustomAllocator<int, 1024>, true>));
+
+    unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    benchmark::RegisterBenchmark("threaded_list/std", BM_ThreadedList<std::allocator<int>>)
+        ->Arg(1 << 12)->ThreadRange(1, static_cast<int>(max_threads))->UseRealTime();
+    benchmark::RegisterBenchmark("threaded_list/pool-threadsafe",
+                                 BM_ThreadedList<CustomAllocator<int, 1024, true, true, true>>)
+        ->Arg(1 << 12)->ThreadRange(1, static_cast<int>(max_threads))->UseRealTime();
+    benchmark::RegisterBenchmark("free_list_contention/mutex", BM_FreeListContention<MutexFreeList>)
+        ->ThreadRange(1, static_cast<int>(max_threads))->UseRealTime();
+    benchmark::RegisterBenchmark("free_list_contention/tagged-stack", BM_FreeListContention<TaggedFreeStack>)
+        ->ThreadRange(1, static_cast<int>(max_threads))->UseRealTime();
+    benchmark::RegisterBenchmark("threaded_list/pool-mutex", BM_ThreadedList<MutexGuarded<int>>)
+        ->Arg(1 << 12)->ThreadRange(1, static_cast<int>(max_threads))->UseRealTime();
+
+    sizes(benchmark::RegisterBenchmark("aligned_iterate/std", BM_AlignedIterate<std::allocator<WideItem>>));
+    sizes(benchmark::RegisterBenchmark("aligned_iterate/natural",
+                                       BM_AlignedIterate<CustomAllocator<WideItem, 1024>>));
+    sizes(benchmark::RegisterBenchmark(
+        "aligned_iterate/slots64",
+        BM_AlignedIterate<CustomAllocator<WideItem, 1024, true, false, false, AlignSlots<64>>>));
+
+    register_map_build<std::allocator<MapNode>>("std");
+    register_map_build<CustomAllocator<MapNode, 1024>>("fixed");
+    register_map_build<CustomAllocator<MapNode, 1024, true, false, false, NaturalAlign, NewBlockSource,
+                                       SharedOwnership, GeometricGrowth<>>>("geometric");
+    register_map_build<CustomAllocator<MapNode, 1024, true, false, false, NaturalAlign, NewBlockSource,
+                                       SharedOwnership, ByteTargetGrowth<>>>("bytes64k");
+    // Узел map<long, long> - 48 байт: остаток блока попадает в класс span'ов
+    // самого узла и не должен оседать в корзинах
+    using LongNode = std::pair<const long, long>;
+    register_map_build<CustomAllocator<LongNode, 1024, true, true, false, NaturalAlign, NewBlockSource,
+                                       SharedOwnership, ByteTargetGrowth<4096>>, long>("long-bytes4k-free");
+    register_map_build<CustomAllocator<LongNode, 1024, true, true>, long>("long-fixed-free");
+#ifdef BLOCKSOURCE_HAS_MMAP
+    register_map_build<CustomAllocator<MapNode, 1024, true, false, false, NaturalAlign, MmapBlockSource<>,
+                                       SharedOwnership, ByteTargetGrowth<(std::size_t(2) << 20)>>>("mmap");
+    register_map_build<CustomAllocator<MapNode, 1024, true, false, false, NaturalAlign,
+                                       MmapBlockSource<MmapPrefault | MmapHugePages>, SharedOwnership,
+                                       ByteTargetGrowth<(std::size_t(2) << 20)>>>("mmap-prefault-huge");
+#endif
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    register_containers<16>();
+    register_containers<64>();
+    register_pool_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
\ No newline at end of file
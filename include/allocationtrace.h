@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Запись трассы выделений включается при сборке: -DCUSTOMALLOCATOR_TRACE=1
+// (в CMake - опция ALLOCATOR_TRACE). Без нее хуки POOL_TRACE(...) не
+// генерируют кода; со сборкой события пишутся, только пока есть активный
+// TraceRecorder.
+#ifndef CUSTOMALLOCATOR_TRACE
+#define CUSTOMALLOCATOR_TRACE 0
+#endif
+
+#if CUSTOMALLOCATOR_TRACE
+#define POOL_TRACE(expr) (expr)
+#else
+#define POOL_TRACE(expr) ((void)0)
+#endif
+
+enum class TraceOp : std::uint8_t {
+    Allocate = 0,
+    Deallocate = 1,
+    // Выделение по address выросло на месте до count элементов
+    Expand = 2,
+    // Пул уничтожен вместе со всей памятью
+    PoolDestroyed = 3
+};
+
+// Формат файла: TraceHeader, затем записи TraceRecord подряд
+// (little-endian, как в памяти машины, которая писала трассу)
+struct TraceHeader {
+    char magic[4];
+    std::uint32_t version;
+};
+
+struct TraceRecord {
+    std::uint64_t time_ns;    // от старта записи
+    std::uint64_t address;    // связывает allocate с deallocate и expand
+    std::uint32_t pool;       // номер пула в порядке первого появления
+    std::uint32_t elem_size;  // sizeof(T) аллокатора, сделавшего вызов
+    std::uint32_t count;      // число элементов
+    std::uint8_t op;          // TraceOp
+    std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(TraceRecord) == 32, "trace record layout must stay fixed");
+
+constexpr char trace_magic[4] = {'C', 'A', 'T', 'R'};
+constexpr std::uint32_t trace_version = 1;
+
+// Пишет события всех пулов процесса в один файл. Одновременно активен
+// не больше одного рекордера; он должен пережить все пулы, выделения
+// которых записываются, либо быть остановлен раньше.
+class TraceRecorder {
+public:
+    explicit TraceRecorder(const std::string& path)
+        : file_(std::fopen(path.c_str(), "wb")),
+          start_(std::chrono::steady_clock::now())
+    {
+        if (!file_) {
+            throw std::runtime_error("cannot open trace file " + path);
+        }
+        TraceHeader header;
+        std::memcpy(header.magic, trace_magic, sizeof(header.magic));
+        header.version = trace_version;
+        if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+            std::fclose(file_);
+            throw std::runtime_error("cannot write trace file " + path);
+        }
+    }
+
+    ~TraceRecorder() {
+        stop();
+        std::fclose(file_);
+    }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // Сделать рекордер активным для всех пулов процесса
+    void start() noexcept {
+        current().store(this, std::memory_order_release);
+    }
+
+    void stop() noexcept {
+        TraceRecorder* self = this;
+        current().compare_exchange_strong(self, nullptr, std::memory_order_acq_rel);
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fflush(file_);
+    }
+
+    static TraceRecorder* active() noexcept {
+        return current().load(std::memory_order_acquire);
+    }
+
+    void record(TraceOp op, const void* pool, const void* p,
+                std::size_t elem_size, std::size_t count) noexcept {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        TraceRecord rec{};
+        rec.time_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_).count());
+        rec.address = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p));
+        rec.elem_size = static_cast<std::uint32_t>(elem_size);
+        rec.count = static_cast<std::uint32_t>(count);
+        rec.op = static_cast<std::uint8_t>(op);
+
+        auto it = pools_.find(pool);
+        if (it == pools_.end()) {
+            if (op == TraceOp::PoolDestroyed) return;
+            try {
+                it = pools_.emplace(pool, next_pool_++).first;
+            } catch (...) {
+                return;
+            }
+        }
+        rec.pool = it->second;
+        // Адрес пула может достаться новому пулу - тот получит новый номер
+        if (op == TraceOp::PoolDestroyed) {
+            pools_.erase(it);
+        }
+
+        if (std::fwrite(&rec, sizeof(rec), 1, file_) == 1) {
+            ++records_;
+        }
+    }
+
+    std::size_t records() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return records_;
+    }
+
+private:
+    static std::atomic<TraceRecorder*>& current() noexcept {
+        static std::atomic<TraceRecorder*> recorder{nullptr};
+        return recorder;
+    }
+
+    std::FILE* file_;
+    const std::chrono::steady_clock::time_point start_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<const void*, std::uint32_t> pools_;
+    std::uint32_t next_pool_ = 0;
+    std::size_t records_ = 0;
+};
+
+// Точка входа хуков POOL_TRACE: без активного рекордера - одна атомарная загрузка
+inline void trace_event(TraceOp op, const void* pool, const void* p,
+                        std::size_t elem_size, std::size_t count) noexcept {
+    if (TraceRecorder* recorder = TraceRecorder::active()) {
+        recorder->record(op, pool, p, elem_size, count);
+    }
+}
+
+// Прочитать трассу целиком
+inline std::vector<TraceRecord> read_trace(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("cannot open trace file " + path);
+    }
+
+    TraceHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1
+        || std::memcmp(header.magic, trace_magic, sizeof(header.magic)) != 0
+        || header.version != trace_version) {
+        std::fclose(file);
+        throw std::runtime_error("not an allocation trace: " + path);
+    }
+
+    std::vector<TraceRecord> records;
+    TraceRecord rec;
+    try {
+        while (std::fread(&rec, sizeof(rec), 1, file) == 1) {
+            records.push_back(rec);
+        }
+    } catch (...) {
+        std::fclose(file);
+        throw;
+    }
+    std::fclose(file);
+    return records;
+}
\ No newline at end of file
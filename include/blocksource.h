@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define BLOCKSOURCE_HAS_MMAP 1
+#endif
+
+// Источники блоков для PoolState.
+// Источник выдает сырую память под блок и принимает ее обратно:
+//   void* allocate(std::size_t bytes, std::size_t align) noexcept;  // nullptr при неудаче
+//   void deallocate(void* p, std::size_t bytes, std::size_t align) noexcept;
+// Источник копируется в каждый пул, созданный от аллокатора (в том числе
+// при rebind), поэтому источник с состоянием должен ссылаться на общий
+// ресурс, а не владеть им.
+
+// Глобальный operator new с нужным выравниванием
+struct NewBlockSource {
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        return ::operator new(bytes, std::align_val_t(align), std::nothrow);
+    }
+
+    void deallocate(void* p, std::size_t, std::size_t align) noexcept {
+        ::operator delete(p, std::align_val_t(align));
+    }
+};
+
+// malloc/free; для выравнивания сверх max_align_t - aligned_alloc
+struct MallocBlockSource {
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        if (align <= alignof(std::max_align_t)) {
+            return std::malloc(bytes);
+        }
+#ifdef _WIN32
+        return ::_aligned_malloc(bytes, align);
+#else
+        // aligned_alloc требует размер, кратный выравниванию
+        return std::aligned_alloc(align, (bytes + align - 1) / align * align);
+#endif
+    }
+
+    void deallocate(void* p, std::size_t, std::size_t align) noexcept {
+#ifdef _WIN32
+        if (align > alignof(std::max_align_t)) {
+            ::_aligned_free(p);
+            return;
+        }
+#else
+        (void)align;
+#endif
+        std::free(p);
+    }
+};
+
+// Внешний буфер (статический, заранее выделенный, закрепленный, разделяемый),
+// из которого блоки нарезаются по порядку. Вернуть можно только последний
+// выданный блок; остальное освобождается вместе с буфером у его владельца.
+class StaticArena {
+public:
+    StaticArena(void* buffer, std::size_t size) noexcept
+        : begin_(static_cast<char*>(buffer)), top_(begin_), end_(begin_ + size) {}
+
+    template <typename Byte, std::size_t N>
+    explicit StaticArena(Byte (&buffer)[N]) noexcept
+        : StaticArena(buffer, sizeof(buffer)) {}
+
+    StaticArena(const StaticArena&) = delete;
+    StaticArena& operator=(const StaticArena&) = delete;
+
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        void* p = top_;
+        std::size_t space = static_cast<std::size_t>(end_ - top_);
+        if (!std::align(align, bytes, p, space)) {
+            return nullptr;
+        }
+        top_ = static_cast<char*>(p) + bytes;
+        return p;
+    }
+
+    void deallocate(void* p, std::size_t bytes) noexcept {
+        if (static_cast<char*>(p) + bytes == top_) {
+            top_ = static_cast<char*>(p);
+        }
+    }
+
+    std::size_t used() const noexcept {
+        return static_cast<std::size_t>(top_ - begin_);
+    }
+
+    std::size_t capacity() const noexcept {
+        return static_cast<std::size_t>(end_ - begin_);
+    }
+
+private:
+    char* begin_;
+    char* top_;
+    char* end_;
+};
+
+// Блоки из StaticArena; сама арена принадлежит вызывающему и должна
+// пережить все пулы, которые из нее берут память
+struct StaticBufferSource {
+    StaticArena* arena = nullptr;
+
+    StaticBufferSource() noexcept = default;
+    explicit StaticBufferSource(StaticArena& arena) noexcept : arena(&arena) {}
+
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        return arena ? arena->allocate(bytes, align) : nullptr;
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t) noexcept {
+        if (arena) {
+            arena->deallocate(p, bytes);
+        }
+    }
+};
+
+// Блоки из другого аллокатора, например из вышестоящего CustomAllocator.
+// Память запрашивается в единицах max_align_t, поэтому выравнивание
+// сверх alignof(std::max_align_t) не поддерживается.
+template <typename Alloc>
+struct AllocatorBlockSource {
+    using unit_allocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::max_align_t>;
+    using unit_traits = std::allocator_traits<unit_allocator>;
+
+    unit_allocator upstream;
+
+    AllocatorBlockSource() = default;
+    explicit AllocatorBlockSource(const Alloc& alloc) : upstream(alloc) {}
+
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        if (align > alignof(std::max_align_t)) {
+            return nullptr;
+        }
+        try {
+            return unit_traits::allocate(upstream, units(bytes));
+        } catch (...) {
+            return nullptr;
+        }
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t) noexcept {
+        unit_traits::deallocate(upstream, static_cast<std::max_align_t*>(p), units(bytes));
+    }
+
+private:
+    static std::size_t units(std::size_t bytes) noexcept {
+        return (bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+    }
+};
+
+#ifdef BLOCKSOURCE_HAS_MMAP
+
+// Отдать ядру целые страницы внутри [p, p + bytes) (MADV_DONTNEED): адреса
+// остаются за процессом, но страницы перестают занимать RSS и при
+// следующем обращении приходят обнуленными. Возвращает отданные байты.
+inline std::size_t purge_pages(void* p, std::size_t bytes) noexcept {
+    static const std::uintptr_t page = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(p) + page - 1) & ~(page - 1);
+    std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(p) + bytes) & ~(page - 1);
+    if (end <= begin || ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) != 0) {
+        return 0;
+    }
+    return end - begin;
+}
+
+// Флаги MmapBlockSource
+enum MmapFlags : unsigned {
+    MmapDefault = 0,
+    // Сразу отобразить все страницы (MAP_POPULATE или ручное касание),
+    // чтобы не платить page fault'ами при первом обращении
+    MmapPrefault = 1u << 0,
+    // Прозрачные huge pages: блоки от 2 МиБ выравниваются по 2 МиБ и
+    // помечаются MADV_HUGEPAGE. Если ядро их не дает, остаются обычные страницы
+    MmapHugePages = 1u << 1
+};
+
+// Блоки напрямую из mmap, возврат через munmap
+template <unsigned Flags = MmapDefault>
+struct MmapBlockSource {
+    static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        std::size_t page = page_size();
+        std::size_t length = round_up(bytes, page);
+        std::size_t boundary = align > page ? align : page;
+        if ((Flags & MmapHugePages) && length >= huge_page_size && boundary < huge_page_size) {
+            boundary = huge_page_size;
+        }
+
+        int map_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+        // При доп. выравнивании заполняем уже обрезанный участок, а не весь запас
+        if ((Flags & MmapPrefault) && boundary == page) {
+            map_flags |= MAP_POPULATE;
+        }
+#endif
+        // Берем с запасом и отрезаем невыровненные края
+        std::size_t extra = boundary > page ? boundary : 0;
+        void* raw = ::mmap(nullptr, length + extra, PROT_READ | PROT_WRITE, map_flags, -1, 0);
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+
+        char* start = static_cast<char*>(raw);
+        if (extra) {
+            char* aligned = reinterpret_cast<char*>(
+                round_up(reinterpret_cast<std::uintptr_t>(start), boundary));
+            std::size_t head = static_cast<std::size_t>(aligned - start);
+            if (head) {
+                ::munmap(start, head);
+            }
+            std::size_t tail = extra - head;
+            if (tail) {
+                ::munmap(aligned + length, tail);
+            }
+            start = aligned;
+        }
+
+#ifdef MADV_HUGEPAGE
+        if ((Flags & MmapHugePages) && length >= huge_page_size) {
+            ::madvise(start, length, MADV_HUGEPAGE);
+        }
+#endif
+        if ((Flags & MmapPrefault) && !map_flags_populated(map_flags)) {
+            for (std::size_t off = 0; off < length; off += page) {
+                static_cast<volatile char*>(static_cast<void*>(start))[off] = 0;
+            }
+        }
+        return start;
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t) noexcept {
+        ::munmap(p, round_up(bytes, page_size()));
+    }
+
+private:
+    static std::size_t page_size() noexcept {
+        static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    static constexpr std::size_t round_up(std::size_t n, std::size_t align) noexcept {
+        return (n + align - 1) / align * align;
+    }
+
+    static constexpr bool map_flags_populated(int map_flags) noexcept {
+#ifdef MAP_POPULATE
+        return (map_flags & MAP_POPULATE) != 0;
+#else
+        (void)map_flags;
+        return false;
+#endif
+    }
+};
+
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <new>
@@ -11,148 +12,1253 @@
 #include <map>
 #include <string>
 #include <limits>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 
-template <typename T>
+#include "lockfreestack.h"
+#include "poolpolicies.h"
+#include "blocksource.h"
+#include "threadcache.h"
+#include "poolstats.h"
+#include "allocationtrace.h"
+
+// Односвязный свободный список внутри освобожденных слотов:
+// первые sizeof(void*) байт слота содержат указатель на следующий.
+// memcpy, т.к. слот может быть не выровнен под void*.
+struct IntrusiveFreeList {
+    void push(void* p) noexcept {
+        std::memcpy(p, &head, sizeof(void*));
+        head = p;
+    }
+
+    void* pop() noexcept {
+        void* p = head;
+        if (p) {
+            std::memcpy(&head, p, sizeof(void*));
+        }
+        return p;
+    }
+
+    void clear() noexcept {
+        head = nullptr;
+    }
+
+    void* head = nullptr;
+};
+
+// Как trim() и decay() освобождают простаивающую память пула
+enum class TrimMode {
+    // Вернуть блоки источнику
+    Release,
+    // Оставить блоки в пуле, но отдать ядру их страницы (madvise):
+    // только страницы, целиком лежащие в блоке; без mmap - как Release
+    Purge
+};
+
+// Байтовая арена, общая для всех rebind'ов одного аллокатора.
+// Память режется bump-указателем из блоков; одиночные слоты после
+// освобождения попадают в свободный список своего размера, многоэлементные
+// span'ы - в корзины по классам размера. Вся служебная информация лежит
+// в самой памяти пула: блоки связаны заголовками в своем начале, span'ы -
+// заголовками внутри себя, так что рост пула не выделяет ничего сверх блоков.
+// Concurrent = true: пул разделяется потоками. Свободные списки слотов
+// становятся lock-free стеками, остальное защищается mutex.
+// Align - политика выравнивания блоков и выделений (poolpolicies.h).
+// Source - откуда берутся блоки (blocksource.h).
+// Growth - политика размера новых блоков (poolpolicies.h).
+// Slots - где живут одиночные слоты PerElementFree (poolpolicies.h).
+// Крупные многоэлементные запросы (больше половины самого большого блока
+// и больше min_large_bytes) берутся у источника отдельными блоками и не
+// трогают bump-указатель.
+template <bool Concurrent = false,
+          typename Align = NaturalAlign,
+          typename Source = NewBlockSource,
+          typename Growth = FixedGrowth,
+          typename Slots = FreeListSlots>
 struct PoolState {
     using size_type = std::size_t;
+    using FreeList = std::conditional_t<Concurrent, TaggedFreeStack, IntrusiveFreeList>;
+
+    using source_type = Source;
+
+    static constexpr bool concurrent = Concurrent;
+    static constexpr bool slabs = Slots::slabs;
+
+    static constexpr size_type granularity = sizeof(void*);
+    // Слоты крупнее живут в корзинах span'ов
+    static constexpr size_type max_slot_bytes = 1024;
+    static constexpr size_type max_slot_align =
+        Align::slot > cache_line_size ? Align::slot : cache_line_size;
+    static constexpr size_type block_align =
+        Align::block > alignof(std::max_align_t) ? Align::block : alignof(std::max_align_t);
+    static constexpr size_type min_slab_bytes = 4096;
+    // Крупное выделение не меньше порога mmap в glibc по умолчанию: мельче
+    // отдельный блок все равно пришел бы из кучи источника и не вернул бы
+    // память системе, а в арене выделение растет на месте и переиспользуется
+    static constexpr size_type min_large_bytes = size_type(128) << 10;
+
+    // Узел индекса блоков по адресу: декартово дерево (treap) в заголовках
+    // самих блоков, обычных и крупных. Ключ - адрес узла, приоритет - хэш
+    // адреса, так что глубина в среднем O(log n) без генератора случайных чисел
+    struct BlockNode {
+        BlockNode* left;
+        BlockNode* right;
+        size_type bytes;  // весь блок вместе с заголовком
+    };
+
+    // Заголовок в начале каждого блока. Блоки образуют список: от первого
+    // до текущего - уже использованные, после текущего - сохраненные
+    // после reset()/rollback() или зарезервированные заранее
+    struct BlockHeader : BlockNode {
+        BlockHeader* next;
+    };
+
+    // Место под заголовок, после которого начинается полезная часть блока
+    static constexpr size_type header_bytes =
+        (sizeof(BlockHeader) + block_align - 1) / block_align * block_align;
+
+    // Заголовок освобожденного span'а лежит в его первых байтах;
+    // memcpy, т.к. span может быть не выровнен под указатель.
+    // Span'ы короче заголовка хранят только next и считаются длиной
+    // sizeof(void*): все они попадают в один класс short_span_class
+    struct FreeSpan {
+        void* next;
+        size_type bytes;
+    };
+    static_assert(sizeof(FreeSpan) == 2 * sizeof(void*), "short spans must fill exactly one size class");
 
-    explicit PoolState(size_type chunk_elems)
-        : chunk_elems(chunk_elems),
-          element_size(sizeof(T)),
-          current_block_index(0),
-          current_offset(0)
+    // Заголовок отдельного блока крупного выделения лежит перед ним;
+    // двусвязный список, чтобы освобождение было O(1). serial растет с
+    // каждым блоком: по нему rollback() находит блоки, взятые после отметки
+    struct LargeHeader : BlockNode {
+        LargeHeader* prev;
+        LargeHeader* next;
+        size_type align;
+        size_type serial;
+    };
+
+    // Slab под одиночные слоты одного размера (Slots::slabs): заголовок,
+    // битовая карта занятости из bitmap_words слов, затем сами слоты.
+    // Slab выровнен по своему размеру, так что заголовок находится
+    // по адресу слота маской.
+    struct SlabHeader : BlockNode {
+        SlabHeader* prev;      // в списке своего класса
+        SlabHeader* next;
+        size_type capacity;    // слотов
+        size_type live;        // занятых слотов
+        size_type data_offset; // начало слотов от заголовка
+        size_type hint;        // слово карты, с которого искать свободный слот
+        bool purged;           // запасной slab, страницы которого отданы ядру
+    };
+
+    // Slab'ы одного размера слота: с свободными слотами, полные, запасные пустые
+    struct SlabClass {
+        SlabHeader* partial = nullptr;
+        SlabHeader* full = nullptr;
+        SlabHeader* spare = nullptr;
+        size_type spare_count = 0;
+        size_type free_slots = 0;  // в partial
+    };
+
+    static constexpr size_type round_up(size_type n, size_type align) noexcept {
+        return (n + align - 1) / align * align;
+    }
+
+    // Выравнивание начала любого выделения элементов T
+    template <typename T>
+    static constexpr size_type elem_align() noexcept {
+        return Align::slot > alignof(T) ? Align::slot : alignof(T);
+    }
+
+    // Размер одиночного слота под T: вмещает void* и кратен выравниванию
+    template <typename T>
+    static constexpr size_type slot_size() noexcept {
+        size_type align = elem_align<T>() > granularity ? elem_align<T>() : granularity;
+        return round_up(sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*), align);
+    }
+
+    // Слоты одного размера всегда выровнены одинаково (по младшему биту
+    // размера), поэтому освобожденный слот подходит любому типу этого размера
+    static constexpr size_type slot_align(size_type slot) noexcept {
+        size_type low = slot & (~slot + 1);
+        return low < max_slot_align ? low : max_slot_align;
+    }
+
+    explicit PoolState(size_type chunk_elems, const Source& source = Source())
+        : source(source),
+          chunk_elems(chunk_elems)
     {
         if (chunk_elems == 0) {
             throw std::invalid_argument("chunk_elems must be positive");
         }
-        // Сразу создаем первый блок
-        add_block(chunk_elems);
     }
 
     ~PoolState() {
+        POOL_TRACE(trace_event(TraceOp::PoolDestroyed, this, nullptr, 0, 0));
         release_all_blocks();
     }
 
     PoolState(const PoolState&) = delete;
     PoolState& operator=(const PoolState&) = delete;
 
-    // Добавить новый блок
-    void add_block(size_type elems) {
-        if (elems == 0) return;
-        
-        size_type bytes = elems * element_size;
-        void* raw = ::operator new(bytes, std::nothrow);
+    // Запомнить размер слота типа, работающего с ареной: reserve_elements
+    // резервирует место под самый крупный из них (например, под узел std::map)
+    void note_slot(size_type slot) noexcept {
+        if (slot > largest_slot) {
+            largest_slot = slot;
+        }
+    }
+
+    // Взять у источника блок из bytes байт вместе с заголовком. Блок
+    // еще не в списке; его полезная часть сразу учтена в free_bytes
+    BlockHeader* new_block(size_type bytes) {
+        void* raw = source.allocate(bytes, block_align);
         if (!raw) {
             throw std::bad_alloc();
         }
-        blocks.push_back(raw);
-        block_elems.push_back(elems);
-        current_block_index = blocks.size() - 1;
-        current_offset = 0;
+        auto* block = static_cast<BlockHeader*>(raw);
+        block->next = nullptr;
+        block->bytes = bytes;
+        index_insert(block_index, block);
+        ++block_count;
+        capacity_bytes += bytes - header_bytes;
+        free_bytes += bytes - header_bytes;
+        reserved_bytes += bytes;
+        last_block_bytes = bytes;
+        if (bytes > max_block_bytes) {
+            max_block_bytes = bytes;
+        }
+        POOL_STATS(counters.on_block(bytes));
+        return block;
+    }
+
+    // Вставить блок сразу за текущим, чтобы не перепрыгнуть сохраненные;
+    // первый блок пула сразу становится текущим
+    void link_after_current(BlockHeader* block) noexcept {
+        if (!current_block) {
+            block->next = first_block;
+            first_block = block;
+            current_block = block;
+            current_offset = header_bytes;
+            return;
+        }
+        block->next = current_block->next;
+        current_block->next = block;
+    }
+
+    // Сделать текущим следующий за текущим блок; request - запрос,
+    // которому не хватило остатка текущего
+    void switch_to_next(size_type request) noexcept {
+        recycle_tail(request);
+        current_block = current_block->next;
+        current_offset = header_bytes;
+        if (current_block == purged_from) {
+            purged_from = current_block->next;
+            purged_bytes -= current_block->bytes - header_bytes;
+        }
+        note_idle();
+    }
+
+    // Остаток текущего блока перед переходом к другому уходит в корзины
+    // span'ов и достается следующим подходящим запросам. Остаток короче
+    // request в классе request бесполезен: такие же запросы (узлы одного
+    // контейнера) только перебирали бы его при каждом выделении. Такой
+    // остаток бросается до reset() или отката.
+    void recycle_tail(size_type request) noexcept {
+        size_type left = current_block->bytes - current_offset;
+        if (left == 0) return;
+        char* tail = reinterpret_cast<char*>(current_block) + current_offset;
+        bool dead = left < request && span_class(left) == span_class(request);
+        if (!dead && push_span(tail, left)) {
+            POOL_STATS(counters.on_tail_recycled(left));
+        } else {
+            POOL_STATS(counters.on_tail_waste(left));
+        }
+        free_bytes -= left;
+        current_offset = current_block->bytes;
+    }
+
+    // Смещение от начала блока, с которого выделение будет выровнено по align
+    static size_type aligned_offset(const BlockHeader* block, size_type offset, size_type align) noexcept {
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block);
+        return round_up(base + offset, align) - base;
     }
 
-    bool current_block_has(size_type n) const noexcept {
-        if (blocks.empty()) return false;
-        return current_offset + n <= block_elems[current_block_index];
+    bool current_block_has(size_type bytes, size_type align) const noexcept {
+        if (!current_block) return false;
+        return aligned_offset(current_block, current_offset, align) + bytes <= current_block->bytes;
     }
 
-    void* alloc_from_current(size_type n) {
-        if (!current_block_has(n)) {
+    void* alloc_from_current(size_type bytes, size_type align) {
+        if (!current_block_has(bytes, align)) {
             throw std::bad_alloc();
         }
-        char* base = static_cast<char*>(blocks[current_block_index]);
-        void* ptr = base + current_offset * element_size;
-        current_offset += n;
+        size_type offset = aligned_offset(current_block, current_offset, align);
+        void* ptr = reinterpret_cast<char*>(current_block) + offset;
+        free_bytes -= offset + bytes - current_offset;
+        current_offset = offset + bytes;
         return ptr;
     }
 
-    void reserve_elements(size_type total_elems) {
-        if (total_elems == 0) return;
-        
-        size_type available = 0;
-        for (size_type i = 0; i < blocks.size(); ++i) {
-            if (i == current_block_index) {
-                available += (block_elems[i] - current_offset);
+    // Выделить bytes байт: из корзин, из текущего блока или из нового блока.
+    // Новый блок вмещает не меньше chunk_elems элементов размера elem_size;
+    // запрос крупнее обычного блока получает блок с запасом еще на обычный,
+    // чтобы следующие мелкие выделения продолжили bump в нем же, а не в
+    // блоке, занятом ровно под запрос.
+    // Без expandable пул ограничен одним блоком, который создается лениво.
+    void* allocate_bytes(size_type bytes, size_type align, size_type elem_size, bool expandable) {
+        if (void* p = pop_span(bytes, align)) {
+            return p;
+        }
+
+        if (current_block_has(bytes, align)) {
+            return alloc_from_current(bytes, align);
+        }
+
+        if (advance_block(bytes, align)) {
+            return alloc_from_current(bytes, align);
+        }
+
+        if (!expandable && current_block) {
+            throw std::bad_alloc();
+        }
+
+        size_type want = bytes + (align > block_align ? align - block_align : 0);
+        size_type chunk = chunk_elems * elem_size;
+        if (expandable && want > chunk) {
+            want += chunk;
+        }
+        add_next_block(want, chunk, bytes);
+        return alloc_from_current(bytes, align);
+    }
+
+    // Порог крупного выделения для элементов размера elem_size: половина
+    // большего из обычного блока под такие элементы и самого большого
+    // блока арены, но не меньше min_large_bytes. Порог растет вместе с
+    // блоками, поэтому deallocate узнает крупное выделение по индексу
+    // крупных блоков, а не по размеру.
+    size_type large_threshold(size_type elem_size) const noexcept {
+        size_type block = Growth::next_block(0, chunk_elems * elem_size, 0);
+        size_type half = (block > max_block_bytes ? block : max_block_bytes) / 2;
+        return half > min_large_bytes ? half : min_large_bytes;
+    }
+
+    // Одиночный элемент крупным не бывает: он идет в слот
+    bool is_large(size_type bytes, size_type elem_size) const noexcept {
+        return bytes > elem_size && bytes > large_threshold(elem_size);
+    }
+
+    static size_type large_offset(size_type align) noexcept {
+        return round_up(sizeof(LargeHeader), align > alignof(LargeHeader) ? align : alignof(LargeHeader));
+    }
+
+    // Отдельный блок под одно крупное выделение; текущий блок и
+    // bump-указатель не меняются
+    void* allocate_large(size_type bytes, size_type align) {
+        size_type offset = large_offset(align);
+        if (bytes > std::numeric_limits<size_type>::max() - offset) {
+            throw std::bad_alloc();
+        }
+        size_type total = offset + bytes;
+        size_type raw_align = align > block_align ? align : block_align;
+        void* raw = source.allocate(total, raw_align);
+        if (!raw) {
+            throw std::bad_alloc();
+        }
+        auto* header = static_cast<LargeHeader*>(raw);
+        header->prev = nullptr;
+        header->next = large_blocks;
+        header->bytes = total;
+        header->align = raw_align;
+        header->serial = large_serial++;
+        if (large_blocks) {
+            large_blocks->prev = header;
+        }
+        large_blocks = header;
+        index_insert(large_index, header);
+        reserved_bytes += total;
+        POOL_STATS(counters.on_large_block(total));
+        return static_cast<char*>(raw) + offset;
+    }
+
+    // Крупный блок, в который попадает p, или nullptr. По нему deallocate
+    // решает, куда вернуть многоэлементное выделение: порог крупного может
+    // измениться между allocate и deallocate, а блок - нет
+    LargeHeader* find_large(const void* p) const noexcept {
+        return static_cast<LargeHeader*>(find_in(large_index, p));
+    }
+
+    void free_large(LargeHeader* header) noexcept {
+        if (header->prev) {
+            header->prev->next = header->next;
+        } else {
+            large_blocks = header->next;
+        }
+        if (header->next) {
+            header->next->prev = header->prev;
+        }
+        index_erase(large_index, header);
+        reserved_bytes -= header->bytes;
+        POOL_STATS(counters.on_large_release(header->bytes));
+        source.deallocate(header, header->bytes, header->align);
+    }
+
+    // Вернуть источнику крупные блоки с serial не меньше from. Новые
+    // блоки стоят в начале списка, поэтому обход останавливается на
+    // первом более старом
+    void release_large(size_type from) noexcept {
+        while (large_blocks && large_blocks->serial >= from) {
+            free_large(large_blocks);
+        }
+    }
+
+    // Размер slab'а под слоты размера slot: степень двойки, вмещающая
+    // заголовок, карту и не меньше chunk_elems слотов
+    size_type slab_bytes(size_type slot) const noexcept {
+        size_type want = sizeof(SlabHeader) + chunk_elems * slot + chunk_elems / 8 + slot_align(slot);
+        size_type bytes = min_slab_bytes;
+        while (bytes < want) {
+            bytes <<= 1;
+        }
+        return bytes;
+    }
+
+    SlabClass& slab_class(size_type slot) noexcept {
+        return slab_classes[slot / granularity - 1];
+    }
+
+    static std::uint64_t* slab_bitmap(SlabHeader* slab) noexcept {
+        return reinterpret_cast<std::uint64_t*>(slab + 1);
+    }
+
+    static size_type bitmap_words(size_type capacity) noexcept {
+        return (capacity + 63) / 64;
+    }
+
+    // Двусвязные списки slab'ов класса
+    static void slab_push(SlabHeader*& head, SlabHeader* slab) noexcept {
+        slab->prev = nullptr;
+        slab->next = head;
+        if (head) {
+            head->prev = slab;
+        }
+        head = slab;
+    }
+
+    static void slab_unlink(SlabHeader*& head, SlabHeader* slab) noexcept {
+        if (slab->prev) {
+            slab->prev->next = slab->next;
+        } else {
+            head = slab->next;
+        }
+        if (slab->next) {
+            slab->next->prev = slab->prev;
+        }
+    }
+
+    // Разметить пустой slab: биты за capacity заняты навсегда, чтобы
+    // поиск по карте их не выдавал
+    static void slab_clear(SlabHeader* slab) noexcept {
+        std::uint64_t* bits = slab_bitmap(slab);
+        size_type words = bitmap_words(slab->capacity);
+        std::memset(bits, 0, words * sizeof(std::uint64_t));
+        if (size_type tail = slab->capacity % 64) {
+            bits[words - 1] = ~std::uint64_t(0) << tail;
+        }
+        slab->live = 0;
+        slab->hint = 0;
+        slab->purged = false;
+    }
+
+    // Пустой slab в partial: из запаса или новый у источника
+    SlabHeader* add_slab(SlabClass& cls, size_type slot) {
+        SlabHeader* slab = cls.spare;
+        if (slab) {
+            cls.spare = slab->next;
+            --cls.spare_count;
+            if (!slab->purged) {
+                spare_slab_bytes -= slab->bytes;
+            }
+            note_idle();
+        } else {
+            size_type bytes = slab_bytes(slot);
+            void* raw = source.allocate(bytes, bytes);
+            if (!raw) {
+                throw std::bad_alloc();
+            }
+            slab = static_cast<SlabHeader*>(raw);
+            slab->bytes = bytes;
+            size_type words = bitmap_words(bytes / slot);
+            slab->data_offset = round_up(sizeof(SlabHeader) + words * sizeof(std::uint64_t), slot_align(slot));
+            slab->capacity = (bytes - slab->data_offset) / slot;
+            index_insert(block_index, slab);
+            reserved_bytes += bytes;
+            POOL_STATS(counters.on_block(bytes));
+        }
+        slab_clear(slab);
+        slab_push(cls.partial, slab);
+        cls.free_slots += slab->capacity;
+        return slab;
+    }
+
+    // Свободный слот из первого частично занятого slab'а. Без expandable
+    // у каждого размера слота один slab - как один блок у bump-арены:
+    // когда он заполнен, выделение бросает bad_alloc
+    void* slab_allocate(size_type slot, bool expandable = true) {
+        SlabClass& cls = slab_class(slot);
+        if (!cls.partial && !expandable && cls.full) {
+            throw std::bad_alloc();
+        }
+        SlabHeader* slab = cls.partial ? cls.partial : add_slab(cls, slot);
+
+        std::uint64_t* bits = slab_bitmap(slab);
+        size_type words = bitmap_words(slab->capacity);
+        size_type w = slab->hint;
+        while (bits[w] == ~std::uint64_t(0)) {
+            w = w + 1 < words ? w + 1 : 0;
+        }
+        size_type bit = lowest_bit(~bits[w]);
+        bits[w] |= std::uint64_t(1) << bit;
+        slab->hint = w;
+
+        --cls.free_slots;
+        if (++slab->live == slab->capacity) {
+            slab_unlink(cls.partial, slab);
+            slab_push(cls.full, slab);
+        }
+        return reinterpret_cast<char*>(slab) + slab->data_offset + (w * 64 + bit) * slot;
+    }
+
+    void slab_deallocate(void* p, size_type slot) noexcept {
+        SlabClass& cls = slab_class(slot);
+        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(p);
+        auto* slab = reinterpret_cast<SlabHeader*>(addr & ~std::uintptr_t(slab_bytes(slot) - 1));
+
+        size_type index = (addr - address(slab) - slab->data_offset) / slot;
+        size_type w = index / 64;
+        slab_bitmap(slab)[w] &= ~(std::uint64_t(1) << (index % 64));
+        if (w < slab->hint) {
+            slab->hint = w;
+        }
+
+        if (slab->live-- == slab->capacity) {
+            slab_unlink(cls.full, slab);
+            slab_push(cls.partial, slab);
+        }
+        ++cls.free_slots;
+        if (slab->live == 0) {
+            release_slab(cls, slab);
+        }
+    }
+
+    // Опустевший slab - в запас, сверх Slots::spare - источнику
+    void release_slab(SlabClass& cls, SlabHeader* slab) noexcept {
+        slab_unlink(cls.partial, slab);
+        cls.free_slots -= slab->capacity;
+        if (cls.spare_count < Slots::spare) {
+            push_spare(cls, slab);
+            return;
+        }
+        free_slab(slab);
+    }
+
+    void push_spare(SlabClass& cls, SlabHeader* slab) noexcept {
+        slab->next = cls.spare;
+        cls.spare = slab;
+        ++cls.spare_count;
+        if (!slab->purged) {
+            spare_slab_bytes += slab->bytes;
+        }
+    }
+
+    void free_slab(SlabHeader* slab) noexcept {
+        index_erase(block_index, slab);
+        reserved_bytes -= slab->bytes;
+        POOL_STATS(counters.on_block_free(slab->bytes));
+        source.deallocate(slab, slab->bytes, slab->bytes);
+    }
+
+    // Обеспечить count свободных слотов размера slot
+    void slab_reserve(size_type slot, size_type count) {
+        SlabClass& cls = slab_class(slot);
+        while (cls.free_slots < count) {
+            add_slab(cls, slot);
+        }
+    }
+
+    // Все slab'ы пусты: reset() переводит их в запас (сверх Slots::spare
+    // их вернет trim()), release - отдает источнику
+    void slab_reset(bool release) noexcept {
+        spare_slab_bytes = 0;
+        for (SlabClass& cls : slab_classes) {
+            SlabHeader* lists[] = {cls.partial, cls.full, cls.spare};
+            cls = SlabClass();
+            for (SlabHeader* slab : lists) {
+                while (slab) {
+                    SlabHeader* next = slab->next;
+                    if (release) {
+                        free_slab(slab);
+                    } else {
+                        push_spare(cls, slab);
+                    }
+                    slab = next;
+                }
+            }
+        }
+    }
+
+    // После reset() и rollback() за текущим блоком лежат сохраненные
+    // блоки: перейти к следующему, если в него влезает запрос. Дальше
+    // не ищем, чтобы переход оставался O(1): неподошедший блок остается
+    // впереди и будет взят после нового.
+    bool advance_block(size_type bytes, size_type align) noexcept {
+        if (!current_block || !current_block->next) return false;
+        const BlockHeader* next = current_block->next;
+        if (aligned_offset(next, header_bytes, align) + bytes > next->bytes) return false;
+        switch_to_next(bytes);
+        return true;
+    }
+
+    // Новый блок с полезной частью не меньше need байт сразу за текущим;
+    // он становится текущим
+    void add_next_block(size_type need, size_type chunk, size_type request) {
+        BlockHeader* block = new_block(next_block_bytes(need, chunk));
+        link_after_current(block);
+        if (current_block != block) {
+            switch_to_next(request);
+        }
+    }
+
+    // Начать пул заново, не возвращая блоки источнику: bump-указатель
+    // переходит в начало первого блока, свободные списки очищаются.
+    // Все выделения пула к этому моменту должны быть уже не нужны.
+    // Крупные блоки возвращаются источнику: они под конкретный размер.
+    // Slab'ы остаются в пуле пустыми, в запасе своего размера.
+    void reset() noexcept {
+        release_large(0);
+        slab_reset(false);
+        current_block = first_block;
+        current_offset = header_bytes;
+        free_bytes = capacity_bytes;
+        clear_free();
+        POOL_STATS(counters.on_reset());
+    }
+
+    // Позиция bump-указателя для отката
+    struct Marker {
+        BlockHeader* block = nullptr;
+        size_type offset = 0;
+        size_type free_bytes = 0;
+        size_type capacity_bytes = 0;
+        size_type large_serial = 0;
+        size_type in_use = 0;  // для статистики
+    };
+
+    Marker checkpoint() const noexcept {
+        Marker m;
+        m.block = current_block;
+        m.offset = current_offset;
+        m.free_bytes = free_bytes;
+        m.capacity_bytes = capacity_bytes;
+        m.large_serial = large_serial;
+#if CUSTOMALLOCATOR_STATS
+        m.in_use = counters.in_use();
+#endif
+        return m;
+    }
+
+    // Откатить bump-указатель к marker: все, что выделено после него,
+    // считается освобожденным; блоки, добавленные после него, остаются
+    // в пуле, а крупные блоки, взятые после него, возвращаются источнику.
+    // Свободные списки могут указывать в отброшенную память,
+    // поэтому они очищаются целиком: слоты, освобожденные до marker,
+    // вернутся только с reset(). Slab'ы откат не трогает: их слоты
+    // освобождаются только через deallocate. Откатывать - в порядке,
+    // обратном checkpoint(), и не через reset().
+    void rollback(const Marker& m) noexcept {
+        release_large(m.large_serial);
+        if (m.block) {
+            current_block = m.block;
+            current_offset = m.offset;
+            // Блоки, добавленные после отметки, стоят за ней и свободны целиком
+            free_bytes = m.free_bytes + (capacity_bytes - m.capacity_bytes);
+        } else {
+            current_block = first_block;
+            current_offset = header_bytes;
+            free_bytes = capacity_bytes;
+        }
+        clear_free();
+        POOL_STATS(counters.on_rollback(m.in_use));
+    }
+
+    void clear_free() noexcept {
+        for (auto& list : free_lists) {
+            list.clear();
+        }
+        span_bins.fill(nullptr);
+        span_count = 0;
+        span_mask = 0;
+    }
+
+    // Нарастить на месте выделение, которое последним откусило от текущего
+    // блока: достаточно сдвинуть current_offset
+    bool try_expand(void* p, size_type old_bytes, size_type new_bytes) noexcept {
+        if (!current_block || !p) return false;
+        char* base = reinterpret_cast<char*>(current_block);
+        char* ptr = static_cast<char*>(p);
+        if (ptr + old_bytes != base + current_offset) return false;
+
+        size_type offset = static_cast<size_type>(ptr - base);
+        if (new_bytes > current_block->bytes - offset) return false;
+        free_bytes -= new_bytes - old_bytes;
+        current_offset = offset + new_bytes;
+        return true;
+    }
+
+    // Отдать последнему bump-выделению остаток текущего блока целыми
+    // единицами unit, но так, чтобы выделение не превысило limit байт;
+    // возвращает итоговый размер выделения в байтах
+    size_type take_tail(void* p, size_type bytes, size_type unit, size_type limit) noexcept {
+        if (!current_block || !p) return bytes;
+        char* base = reinterpret_cast<char*>(current_block);
+        if (static_cast<char*>(p) + bytes != base + current_offset) return bytes;
+
+        size_type left = current_block->bytes - current_offset;
+        if (limit < bytes + left) {
+            left = limit > bytes ? limit - bytes : 0;
+        }
+        size_type extra = left / unit * unit;
+        free_bytes -= extra;
+        current_offset += extra;
+        return bytes + extra;
+    }
+
+    // Обеспечить bytes байт свободной емкости: остаток текущего блока и
+    // сохраненные блоки за ним учтены в free_bytes, поэтому проверка O(1).
+    // Недостающее добавляется блоком за текущим, текущий не меняется.
+    void reserve_bytes(size_type bytes) {
+        if (bytes <= free_bytes) return;
+        link_after_current(new_block(next_block_bytes(bytes - free_bytes, chunk_elems * largest_slot)));
+    }
+
+    // Размер очередного блока вместе с заголовком: полезная часть не
+    // меньше need и не меньше, чем дала бы политика роста для chunk
+    size_type next_block_bytes(size_type need, size_type chunk) const noexcept {
+        return Growth::next_block(need + header_bytes, chunk + header_bytes, last_block_bytes);
+    }
+
+    // Простаивающая память, которая занимает RSS: сохраненные блоки за
+    // текущим (кроме отданных ядру) и запасные slab'ы
+    size_type idle_bytes() const noexcept {
+        size_type tail = current_block ? current_block->bytes - current_offset : 0;
+        return free_bytes - tail - purged_bytes + spare_slab_bytes;
+    }
+
+    void note_idle() noexcept {
+        size_type idle = idle_bytes();
+        if (idle < idle_low) {
+            idle_low = idle;
+        }
+    }
+
+    // Вернуть простаивающую память сверх keep_bytes: сохраненные блоки за
+    // текущим и запасные slab'ы. Ближайшие к текущему блоки понадобятся
+    // раньше, поэтому в keep_bytes остаются они. Release возвращает
+    // блоки источнику (и те, что уже отданы ядру), Purge оставляет их в
+    // пуле и отдает ядру их страницы. Живые выделения и отметки
+    // checkpoint() не затрагиваются. Возвращает байты, освобожденные
+    // этим вызовом: уже отданное ядру повторно не считается.
+    size_type trim(size_type keep_bytes, TrimMode mode) noexcept {
+#ifndef BLOCKSOURCE_HAS_MMAP
+        mode = TrimMode::Release;
+#endif
+        size_type kept = 0;
+        size_type released = 0;
+
+        if (current_block) {
+            BlockHeader* prev = current_block;
+            BlockHeader* block = prev->next;
+            for (; block != purged_from; prev = block, block = block->next) {
+                size_type usable = block->bytes - header_bytes;
+                if (kept + usable > keep_bytes) break;
+                kept += usable;
+            }
+            if (mode == TrimMode::Release) {
+                prev->next = nullptr;
+                bool purged = false;
+                while (block) {
+                    BlockHeader* next = block->next;
+                    // Страницы отданных ядру блоков уже посчитаны их Purge
+                    purged = purged || block == purged_from;
+                    if (!purged) {
+                        released += block->bytes;
+                    }
+                    free_block(block);
+                    block = next;
+                }
+                purged_from = nullptr;
+                purged_bytes = 0;
             } else {
-                available += block_elems[i];
+                BlockHeader* first_purged = block;
+                for (; block != purged_from; block = block->next) {
+                    released += purge_block(block);
+                    purged_bytes += block->bytes - header_bytes;
+                }
+                purged_from = first_purged;
             }
         }
-        if (available >= total_elems) return;
 
-        size_type need = total_elems - available;
-        while (need > 0) {
-            size_type allocate_elems = std::max(chunk_elems, need);
-            add_block(allocate_elems);
-            if (need <= allocate_elems) break;
-            need -= allocate_elems;
+        for (SlabClass& cls : slab_classes) {
+            for (SlabHeader** link = &cls.spare; SlabHeader* slab = *link;) {
+                if (!slab->purged && kept + slab->bytes <= keep_bytes) {
+                    kept += slab->bytes;
+                    link = &slab->next;
+                    continue;
+                }
+                if (!slab->purged) {
+                    spare_slab_bytes -= slab->bytes;
+                }
+                if (mode == TrimMode::Release) {
+                    *link = slab->next;
+                    --cls.spare_count;
+                    if (!slab->purged) {
+                        released += slab->bytes;
+                    }
+                    free_slab(slab);
+                } else {
+                    if (!slab->purged) {
+                        released += purge_slab(slab);
+                        slab->purged = true;
+                    }
+                    link = &slab->next;
+                }
+            }
+        }
+
+        note_idle();
+        POOL_STATS(counters.on_trim(released, mode == TrimMode::Purge));
+        return released;
+    }
+
+    // Затухание: если с прошлого вызова прошло не меньше idle_for,
+    // вернуть столько простаивающей памяти, сколько ее не понадобилось
+    // за все это время (минимум idle_bytes() за окно). Вызывать
+    // периодически, явно или из PoolDecayThread; первый вызов только
+    // открывает окно.
+    size_type decay(std::chrono::steady_clock::duration idle_for, TrimMode mode,
+                    std::chrono::steady_clock::time_point now) noexcept {
+        if (decay_start != std::chrono::steady_clock::time_point() && now - decay_start < idle_for) {
+            return 0;
+        }
+        size_type released = 0;
+        size_type idle = idle_bytes();
+        if (idle_low > 0) {
+            released = trim(idle - std::min(idle, idle_low), mode);
         }
+        decay_start = now;
+        idle_low = idle_bytes();
+        return released;
+    }
+
+    // Вернуть источнику сохраненный блок, уже исключенный из списка
+    void free_block(BlockHeader* block) noexcept {
+        size_type usable = block->bytes - header_bytes;
+        index_erase(block_index, block);
+        --block_count;
+        capacity_bytes -= usable;
+        free_bytes -= usable;
+        reserved_bytes -= block->bytes;
+        POOL_STATS(counters.on_block_free(block->bytes));
+        source.deallocate(block, block->bytes, block_align);
+    }
+
+    // Заголовки остаются на месте: отдаются только страницы за ними
+    static size_type purge_block(BlockHeader* block) noexcept {
+#ifdef BLOCKSOURCE_HAS_MMAP
+        return purge_pages(reinterpret_cast<char*>(block) + header_bytes, block->bytes - header_bytes);
+#else
+        (void)block;
+        return 0;
+#endif
+    }
+
+    static size_type purge_slab(SlabHeader* slab) noexcept {
+#ifdef BLOCKSOURCE_HAS_MMAP
+        return purge_pages(reinterpret_cast<char*>(slab) + slab->data_offset, slab->bytes - slab->data_offset);
+#else
+        (void)slab;
+        return 0;
+#endif
     }
 
     void release_all_blocks() noexcept {
-        for (void* p : blocks) {
-            ::operator delete(p);
+        release_large(0);
+        slab_reset(true);
+        while (first_block) {
+            BlockHeader* next = first_block->next;
+            source.deallocate(first_block, first_block->bytes, block_align);
+            first_block = next;
         }
-        blocks.clear();
-        block_elems.clear();
-        current_block_index = 0;
+        block_index = nullptr;
+        current_block = nullptr;
+        purged_from = nullptr;
+        purged_bytes = 0;
+        idle_low = 0;
         current_offset = 0;
-        free_list.clear();
+        block_count = 0;
+        capacity_bytes = 0;
+        free_bytes = 0;
+        reserved_bytes = 0;
+        last_block_bytes = 0;
+        max_block_bytes = 0;
+        clear_free();
+        POOL_STATS(counters.on_release());
     }
-    
-    void push_free(void* p) noexcept { 
-        free_list.push_back(p); 
+
+    // Принадлежит ли p блоку этого пула (обычному или крупному): O(log n)
+    bool owns(const void* p) const noexcept {
+        return find_block(p) != nullptr;
     }
-    
-    void* pop_free() noexcept {
-        if (free_list.empty()) return nullptr;
-        void* p = free_list.back();
-        free_list.pop_back();
-        return p;
+
+    // Блок, в который попадает p, или nullptr
+    BlockNode* find_block(const void* p) const noexcept {
+        if (BlockNode* block = find_in(block_index, p)) {
+            return block;
+        }
+        return find_in(large_index, p);
     }
 
+    static BlockNode* find_in(BlockNode* root, const void* p) noexcept {
+        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(p);
+        BlockNode* best = nullptr;
+        for (BlockNode* node = root; node;) {
+            if (address(node) <= addr) {
+                best = node;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        if (best && addr - address(best) < best->bytes) {
+            return best;
+        }
+        return nullptr;
+    }
 
-    std::vector<void*> blocks;
-    std::vector<size_type> block_elems;
+    static std::uintptr_t address(const BlockNode* node) noexcept {
+        return reinterpret_cast<std::uintptr_t>(node);
+    }
 
-    const size_type chunk_elems;
-    const size_type element_size;
+    static std::uint64_t priority(const BlockNode* node) noexcept {
+        std::uint64_t x = address(node);
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
 
-    size_type current_block_index;
-    size_type current_offset;
+    static void index_insert(BlockNode*& root, BlockNode* node) noexcept {
+        node->left = nullptr;
+        node->right = nullptr;
+        BlockNode** link = &root;
+        while (*link && priority(*link) > priority(node)) {
+            link = address(node) < address(*link) ? &(*link)->left : &(*link)->right;
+        }
+        split(*link, node, node->left, node->right);
+        *link = node;
+    }
 
-    std::vector<void*> free_list;
-};
+    static void index_erase(BlockNode*& root, BlockNode* node) noexcept {
+        BlockNode** link = &root;
+        while (*link != node) {
+            link = address(node) < address(*link) ? &(*link)->left : &(*link)->right;
+        }
+        *link = merge(node->left, node->right);
+    }
 
+    // Разрезать поддерево root на узлы с адресом меньше key и остальные
+    static void split(BlockNode* root, const BlockNode* key, BlockNode*& less, BlockNode*& greater) noexcept {
+        BlockNode** l = &less;
+        BlockNode** g = &greater;
+        while (root) {
+            if (address(root) < address(key)) {
+                *l = root;
+                l = &root->right;
+                root = root->right;
+            } else {
+                *g = root;
+                g = &root->left;
+                root = root->left;
+            }
+        }
+        *l = nullptr;
+        *g = nullptr;
+    }
 
-template <typename T>
-class PoolHandle {
-public:
-    using size_type = std::size_t;
+    // Слить поддеревья, где все адреса less меньше адресов greater
+    static BlockNode* merge(BlockNode* less, BlockNode* greater) noexcept {
+        BlockNode* root = nullptr;
+        BlockNode** link = &root;
+        while (less && greater) {
+            if (priority(less) > priority(greater)) {
+                *link = less;
+                link = &less->right;
+                less = less->right;
+            } else {
+                *link = greater;
+                link = &greater->left;
+                greater = greater->left;
+            }
+        }
+        *link = less ? less : greater;
+        return root;
+    }
 
-    explicit PoolHandle(size_type chunk_elems)
-        : state_(std::make_shared<PoolState<T>>(chunk_elems)) {}
+    static constexpr bool has_free_list(size_type slot) noexcept {
+        return slot <= max_slot_bytes;
+    }
 
-    std::shared_ptr<PoolState<T>> get_state() const noexcept {
-        return state_;
+    FreeList& free_list(size_type slot) noexcept {
+        return free_lists[slot / granularity - 1];
     }
 
-    bool valid() const noexcept {
-        return state_ != nullptr;
+    // Одиночный слот размера slot; крупные слоты идут через корзины span'ов
+    void push_free(void* p, size_type slot) noexcept {
+        if (has_free_list(slot)) {
+            free_list(slot).push(p);
+            POOL_STATS(counters.on_free_push(1));
+        } else {
+            push_span(p, slot);
+        }
     }
 
-    void reset() noexcept {
-        state_.reset();
+    void* pop_free(size_type slot) noexcept {
+        if (has_free_list(slot)) {
+            void* p = free_list(slot).pop();
+            if (p) {
+                POOL_STATS(counters.on_free_pop(1));
+            }
+            return p;
+        }
+        return pop_span(slot, slot_align(slot));
     }
 
-private:
-    std::shared_ptr<PoolState<T>> state_;
+    // Класс размера для span из bytes байт: floor(log2(bytes))
+    static constexpr size_type span_class(size_type bytes) noexcept {
+        size_type cls = 0;
+        while (bytes >>= 1) {
+            ++cls;
+        }
+        return cls;
+    }
+
+    static constexpr size_type short_span_class = span_class(sizeof(void*));
+    // Сколько span'ов своего класса pop_span проверяет до перехода к старшим
+    static constexpr size_type span_probes = 4;
+
+    // Вернуть освобожденный span в корзину его класса; false, если span
+    // короче указателя
+    bool push_span(void* p, size_type bytes) noexcept {
+        if (!p || bytes < sizeof(void*)) return false;
+        size_type cls = span_class(bytes);
+        if (cls == short_span_class) {
+            std::memcpy(p, &span_bins[cls], sizeof(void*));
+        } else {
+            FreeSpan span{span_bins[cls], bytes};
+            std::memcpy(p, &span, sizeof(span));
+        }
+        span_bins[cls] = p;
+        span_mask |= std::uint64_t(1) << cls;
+        ++span_count;
+        return true;
+    }
+
+    static FreeSpan load_span(const void* p, size_type cls) noexcept {
+        FreeSpan span;
+        if (cls == short_span_class) {
+            std::memcpy(&span.next, p, sizeof(void*));
+            span.bytes = sizeof(void*);
+        } else {
+            std::memcpy(&span, p, sizeof(span));
+        }
+        return span;
+    }
+
+    // Найти ранее освобожденный span, в который после выравнивания влезает
+    // bytes байт. Отрезанные до и после куски возвращаются в корзины.
+    // Поиск ограничен: не больше span_probes span'ов своего класса и
+    // верхние span'ы старших, так что выделение не замедляется с ростом
+    // корзин.
+    void* pop_span(size_type bytes, size_type align) noexcept {
+        if (span_count == 0 || bytes == 0) return nullptr;
+
+        // Свой класс - первые span_probes от последнего освобожденного:
+        // span'ы в нем бывают и короче запроса
+        size_type own = span_class(bytes);
+        void* prev = nullptr;
+        void* head = span_bins[own];
+        for (size_type probe = 0; head && probe < span_probes; ++probe) {
+            FreeSpan span = load_span(head, own);
+            if (char* p = fit_span(head, span.bytes, bytes, align)) {
+                unlink_span(own, prev, span.next);
+                return take_from_span(head, span.bytes, p, bytes);
+            }
+            prev = head;
+            head = span.next;
+        }
+
+        // В старших классах любой span длиннее запроса, и хватает проверить
+        // верхний; непустые корзины - по маске
+        std::uint64_t mask = span_mask & (~std::uint64_t(1) << own);
+        while (mask) {
+            size_type c = lowest_bit(mask);
+            mask &= mask - 1;
+            void* head = span_bins[c];
+            FreeSpan span = load_span(head, c);
+            if (char* p = fit_span(head, span.bytes, bytes, align)) {
+                unlink_span(c, nullptr, span.next);
+                return take_from_span(head, span.bytes, p, bytes);
+            }
+        }
+        return nullptr;
+    }
+
+    // Убрать из корзины c span, стоящий за prev (nullptr - верхний)
+    void unlink_span(size_type c, void* prev, void* next) noexcept {
+        if (prev) {
+            std::memcpy(prev, &next, sizeof(void*));
+        } else {
+            span_bins[c] = next;
+            if (!next) {
+                span_mask &= ~(std::uint64_t(1) << c);
+            }
+        }
+        --span_count;
+    }
+
+    static size_type lowest_bit(std::uint64_t mask) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<size_type>(__builtin_ctzll(mask));
+#else
+        size_type bit = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    static char* fit_span(void* ptr, size_type span_bytes, size_type bytes, size_type align) noexcept {
+        char* begin = static_cast<char*>(ptr);
+        std::uintptr_t aligned = round_up(reinterpret_cast<std::uintptr_t>(begin), align);
+        char* p = begin + (aligned - reinterpret_cast<std::uintptr_t>(begin));
+        if (p + bytes > begin + span_bytes) return nullptr;
+        return p;
+    }
+
+    void* take_from_span(void* ptr, size_type span_bytes, char* p, size_type bytes) noexcept {
+        char* begin = static_cast<char*>(ptr);
+        char* end = begin + span_bytes;
+        push_span(begin, static_cast<size_type>(p - begin));
+        push_span(p + bytes, static_cast<size_type>(end - (p + bytes)));
+        return p;
+    }
+
+
+    Source source;
+
+    BlockHeader* first_block = nullptr;
+    BlockHeader* current_block = nullptr;
+    // Индексы по адресу: блоки и slab'ы арены; отдельно крупные блоки
+    BlockNode* block_index = nullptr;
+    BlockNode* large_index = nullptr;
+    size_type current_offset = 0;  // от начала текущего блока
+    size_type block_count = 0;
+    size_type last_block_bytes = 0;
+
+    // Полезная емкость всех блоков и свободная ее часть для bump-указателя:
+    // остаток текущего блока плюс сохраненные блоки за ним
+    size_type capacity_bytes = 0;
+    size_type free_bytes = 0;
+    // Все, что взято у источника: блоки с заголовками, slab'ы, крупные блоки
+    size_type reserved_bytes = 0;
+    size_type max_block_bytes = 0;
+
+    // Сохраненные блоки, страницы которых отданы ядру, - хвост списка
+    // начиная с purged_from; purged_bytes - их полезная емкость
+    BlockHeader* purged_from = nullptr;
+    size_type purged_bytes = 0;
+    // Запасные slab'ы, кроме отданных ядру
+    size_type spare_slab_bytes = 0;
+
+    // Окно decay(): начало и минимум idle_bytes() с его начала
+    std::chrono::steady_clock::time_point decay_start{};
+    size_type idle_low = 0;
+
+    const size_type chunk_elems;
+    size_type largest_slot = 0;
+
+    std::array<FreeList, max_slot_bytes / granularity> free_lists;
+
+    // Корзины освобожденных многоэлементных span'ов по классам размера
+    // Корзина - стек span'ов, связанных через их заголовки
+    std::array<void*, std::numeric_limits<size_type>::digits> span_bins{};
+    size_type span_count = 0;
+    // Бит c выставлен, если корзина c не пуста
+    std::uint64_t span_mask = 0;
+    static_assert(std::numeric_limits<size_type>::digits <= 64, "span bins must fit the mask");
+
+    // Slab'ы одиночных слотов по размерам (только при Slots::slabs)
+    std::array<SlabClass, Slots::slabs ? max_slot_bytes / granularity : 0> slab_classes{};
+
+    // Отдельные блоки крупных выделений, новые - в начале
+    LargeHeader* large_blocks = nullptr;
+    size_type large_serial = 0;
+
+    // Используется только в конкурентном режиме: блоки, bump и корзины span'ов
+    std::mutex mutex;
+
+#if CUSTOMALLOCATOR_STATS
+    PoolCounters<Concurrent> counters;
+#endif
+
+    // В конкурентном режиме вызывать под mutex
+    PoolStats stats() const noexcept {
+#if CUSTOMALLOCATOR_STATS
+        return counters.snapshot(span_count);
+#else
+        return PoolStats();
+#endif
+    }
 };
 
 
+// Результат allocate_at_least: указатель и реально доступное число элементов
+// (аналог std::allocation_result из C++23)
+template <typename Pointer, typename SizeType = std::size_t>
+struct allocation_result {
+    Pointer ptr;
+    SizeType count;
+};
+
 template <typename T,
           std::size_t ChunkElems = 10,
           bool Expandable = true,
-          bool PerElementFree = false>
+          bool PerElementFree = false,
+          bool ThreadSafe = false,
+          typename AlignPolicy = NaturalAlign,
+          typename BlockSource = NewBlockSource,
+          typename Ownership = SharedOwnership,
+          typename GrowthPolicy = FixedGrowth,
+          typename SlotPolicy = FreeListSlots>
 class CustomAllocator {
 public:
     using value_type = T;
@@ -167,30 +1273,98 @@ public:
 
     template <typename U>
     struct rebind {
-        using other = CustomAllocator<U, ChunkElems, Expandable, PerElementFree>;
+        using other = CustomAllocator<U, ChunkElems, Expandable, PerElementFree, ThreadSafe, AlignPolicy, BlockSource, Ownership, GrowthPolicy, SlotPolicy>;
     };
 
+public:
+    using State = PoolState<ThreadSafe, AlignPolicy, BlockSource, GrowthPolicy, SlotPolicy>;
+
 private:
-    std::shared_ptr<PoolHandle<T>> handle_;
+    using Owner = typename Ownership::template holder<State>;
+    using Cache = ThreadCache<State, T, Expandable, PerElementFree>;
+
+    static constexpr size_type elem_align = State::template elem_align<T>();
+    static constexpr size_type slot_size = State::template slot_size<T>();
+
+    // Слоты крупнее max_slot_bytes и при BitmapSlabs идут через корзины span'ов
+    static constexpr bool use_slabs = SlotPolicy::slabs && PerElementFree && State::has_free_list(slot_size);
 
-    std::shared_ptr<PoolState<T>> get_state() const noexcept {
-        if (handle_ && handle_->valid()) {
-            return handle_->get_state();
+    static_assert(elem_align <= State::max_slot_align, "element alignment exceeds pool slot alignment");
+    static_assert(!(SlotPolicy::slabs && ThreadSafe), "bitmap slabs are single-threaded only");
+    static_assert(!ThreadSafe || std::is_same_v<Ownership, SharedOwnership>,
+                  "thread-safe pools need atomic shared ownership");
+
+    // Владение пулом; на горячем пути используется только owner_.get()
+    Owner owner_;
+
+    State* get_state() const noexcept {
+        return owner_.get();
+    }
+
+    void note_slot() const noexcept {
+        if (State* state = get_state()) {
+            // rebind'ы общего пула могут создаваться в разных потоках
+            if constexpr (ThreadSafe) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->note_slot(PerElementFree ? slot_size : sizeof(T));
+            } else {
+                state->note_slot(PerElementFree ? slot_size : sizeof(T));
+            }
         }
-        return nullptr;
+    }
+
+    // Без Expandable пул ограничен своим блоком, отдельных блоков нет
+    static bool is_large(const State* state, size_type n) noexcept {
+        return Expandable && state->is_large(n * sizeof(T), sizeof(T));
+    }
+
+    // Многоэлементное выделение; в конкурентном режиме - под mutex
+    void* allocate_span(State* state, size_type n) {
+        if (is_large(state, n)) {
+            return state->allocate_large(n * sizeof(T), elem_align);
+        }
+        return state->allocate_bytes(n * sizeof(T), elem_align, sizeof(T), Expandable);
+    }
+
+    // Крупное выделение узнается по индексу крупных блоков, а не по размеру
+    void deallocate_span(State* state, pointer p, size_type n) noexcept {
+        if constexpr (Expandable) {
+            if (auto* large = state->find_large(p)) {
+                state->free_large(large);
+                return;
+            }
+        }
+        state->push_span(p, n * sizeof(T));
     }
 
 public:
     CustomAllocator() noexcept
-        : handle_(std::make_shared<PoolHandle<T>>(ChunkElems)) {}
+        : owner_(Owner::make(ChunkElems))
+    {
+        note_slot();
+    }
 
+    // Все rebind'ы делят одну арену: узлы std::map берутся из того же пула,
+    // что резервирует и сравнивает внешний аллокатор
     template <typename U>
-    explicit CustomAllocator(const CustomAllocator<U, ChunkElems, Expandable, PerElementFree>& other) noexcept
+    explicit CustomAllocator(const CustomAllocator<U, ChunkElems, Expandable, PerElementFree, ThreadSafe, AlignPolicy, BlockSource, Ownership, GrowthPolicy, SlotPolicy>& other) noexcept
+        : owner_(other.owner_)
     {
-        if (auto other_handle = other.get_handle()) {
+        note_slot();
+    }
 
-            handle_ = std::make_shared<PoolHandle<T>>(ChunkElems);
-        }
+    // Пул, берущий блоки из заданного источника (например, StaticBufferSource)
+    explicit CustomAllocator(const BlockSource& source)
+        : owner_(Owner::make(ChunkElems, source))
+    {
+        note_slot();
+    }
+
+    // Аллокатор поверх пула, которым владеет вызывающий (BorrowedOwnership)
+    explicit CustomAllocator(State& state) noexcept
+        : owner_(Owner::make(state))
+    {
+        note_slot();
     }
 
     CustomAllocator(const CustomAllocator&) noexcept = default;
@@ -200,7 +1374,7 @@ public:
     CustomAllocator& operator=(CustomAllocator&&) noexcept = default;
 
     [[nodiscard]] pointer allocate(size_type n) {
-        auto state = get_state();
+        State* state = get_state();
         if (!state) throw std::bad_alloc();
         if (n == 0) return nullptr;
 
@@ -212,37 +1386,76 @@ public:
             throw std::bad_alloc();
         }
 
-        if constexpr (PerElementFree) {
+        void* p = nullptr;
+        if constexpr (ThreadSafe) {
+            // Одиночные элементы обслуживает кэш потока без захвата мьютекса
             if (n == 1) {
-                void* p = state->pop_free();
-                if (p) return static_cast<pointer>(p);
+                p = Cache::local().allocate(owner_.shared());
+                POOL_STATS(state->counters.on_allocate(Cache::slot));
+            } else {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                p = allocate_span(state, n);
+                POOL_STATS(state->counters.on_allocate(n * sizeof(T)));
+            }
+        } else {
+            if (PerElementFree && n == 1) {
+                if constexpr (use_slabs) {
+                    p = state->slab_allocate(slot_size, Expandable);
+                } else {
+                    p = state->pop_free(slot_size);
+                    if (!p) {
+                        p = state->allocate_bytes(
+                            slot_size, State::slot_align(slot_size), slot_size, Expandable);
+                    }
+                }
+                POOL_STATS(state->counters.on_allocate(slot_size));
+            } else {
+                p = allocate_span(state, n);
+                POOL_STATS(state->counters.on_allocate(n * sizeof(T)));
             }
         }
-
-        if (state->current_block_has(n)) {
-            return static_cast<pointer>(state->alloc_from_current(n));
-        }
-
-        if (!Expandable) {
-            throw std::bad_alloc();
-        }
-
-        size_type want = std::max(n, state->chunk_elems);
-        state->add_block(want);
-        return static_cast<pointer>(state->alloc_from_current(n));
+        POOL_TRACE(trace_event(TraceOp::Allocate, state, p, sizeof(T), n));
+        return static_cast<pointer>(p);
     }
 
     void deallocate(pointer p, size_type n) noexcept {
         if (!p) return;
         
-        auto state = get_state();
+        State* state = get_state();
         if (!state) return;
+        POOL_TRACE(trace_event(TraceOp::Deallocate, state, p, sizeof(T), n));
 
-        if constexpr (PerElementFree) {
+        if constexpr (ThreadSafe) {
             if (n == 1) {
-                state->push_free(p);
+                if constexpr (PerElementFree) {
+                    Cache::local().deallocate(owner_.shared(), p);
+                    POOL_STATS(state->counters.on_reclaim(Cache::slot));
+                }
                 return;
             }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            assert(state->owns(p) && "deallocate: pointer does not belong to this pool");
+            deallocate_span(state, p, n);
+            POOL_STATS(state->counters.on_reclaim(n * sizeof(T)));
+        } else {
+            // Чужой указатель испортил бы свободные списки пула
+            assert(state->owns(p) && "deallocate: pointer does not belong to this pool");
+            if constexpr (PerElementFree) {
+                if (n == 1) {
+                    if constexpr (use_slabs) {
+                        state->slab_deallocate(p, slot_size);
+                    } else {
+                        state->push_free(p, slot_size);
+                    }
+                    POOL_STATS(state->counters.on_reclaim(slot_size));
+                    return;
+                }
+            }
+
+            if (n > 1) {
+                deallocate_span(state, p, n);
+                POOL_STATS(state->counters.on_reclaim(n * sizeof(T)));
+            }
         }
     }
 
@@ -250,27 +1463,194 @@ public:
         return std::numeric_limits<size_type>::max() / sizeof(T);
     }
 
+    // Выделить не меньше n элементов. Если выделение пришлось на конец
+    // текущего блока, вызывающему отдается часть остатка блока, которая
+    // иначе могла бы пропасть при переходе к следующему, - но не больше
+    // еще n элементов: остаток общий для всех rebind'ов пула, и в
+    // нерасширяемом пуле один вектор не должен забирать его целиком.
+    // Дальше вектор растет на месте через try_expand. Освобождать нужно
+    // с count из результата.
+    [[nodiscard]] allocation_result<pointer, size_type> allocate_at_least(size_type n) {
+        pointer p = allocate(n);
+        // Одиночный элемент - это слот свободного списка или кэша потока
+        if (!p || (n == 1 && (PerElementFree || ThreadSafe))) {
+            return {p, n};
+        }
+
+        State* state = get_state();
+        if (is_large(state, n)) {
+            return {p, n};
+        }
+        size_type bytes = n * sizeof(T);
+        size_type limit = bytes > std::numeric_limits<size_type>::max() / 2
+                              ? std::numeric_limits<size_type>::max()
+                              : 2 * bytes;
+        // Выделение остается ниже порога крупного, как и после try_expand
+        if (Expandable && limit > state->large_threshold(sizeof(T))) {
+            limit = state->large_threshold(sizeof(T));
+        }
+        size_type count = n;
+        if constexpr (ThreadSafe) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            count = state->take_tail(p, bytes, sizeof(T), limit) / sizeof(T);
+        } else {
+            count = state->take_tail(p, bytes, sizeof(T), limit) / sizeof(T);
+        }
+        if (count > n) {
+            POOL_STATS(state->counters.on_allocate((count - n) * sizeof(T)));
+            POOL_TRACE(trace_event(TraceOp::Expand, state, p, sizeof(T), count));
+        }
+        return {p, count};
+    }
+
+    // Расширение без переноса: если p - последнее bump-выделение в текущем
+    // блоке и за ним есть место, выделение растет до new_n элементов.
+    // При false память по p не меняется.
+    bool try_expand(pointer p, size_type old_n, size_type new_n) noexcept {
+        State* state = get_state();
+        if (!state || new_n <= old_n || new_n > max_size()) return false;
+        if (!Expandable && new_n > state->chunk_elems) return false;
+        // Мелкое выделение не может стать крупным, а крупное живет в своем блоке
+        if (is_large(state, new_n)) return false;
+
+        bool expanded = false;
+        if constexpr (ThreadSafe) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            expanded = state->try_expand(p, old_n * sizeof(T), new_n * sizeof(T));
+        } else {
+            expanded = state->try_expand(p, old_n * sizeof(T), new_n * sizeof(T));
+        }
+        if (expanded) {
+            POOL_STATS(state->counters.on_allocate((new_n - old_n) * sizeof(T)));
+            POOL_TRACE(trace_event(TraceOp::Expand, state, p, sizeof(T), new_n));
+        }
+        return expanded;
+    }
+
+    // Зарезервировать место под count элементов самого крупного типа,
+    // работающего с ареной (для контейнера - его узлов)
     void reserve_elements(size_type count) {
-        if (auto state = get_state()) {
-            state->reserve_elements(count);
+        if (State* state = get_state()) {
+            if constexpr (ThreadSafe) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->reserve_bytes(count * state->largest_slot);
+            } else {
+                if constexpr (use_slabs) {
+                    // Узлы контейнера пойдут в slab'ы, а не в bump-блоки
+                    if (State::has_free_list(state->largest_slot)) {
+                        state->slab_reserve(state->largest_slot, count);
+                        return;
+                    }
+                }
+                state->reserve_bytes(count * state->largest_slot);
+            }
+        }
+    }
+
+    // Переиспользовать все блоки пула заново без обращений к источнику,
+    // например между запросами. Контейнеры на этом пуле должны быть уже
+    // уничтожены (или больше не использоваться) во всех копиях и rebind'ах.
+    void reset() noexcept {
+        static_assert(!ThreadSafe, "thread caches keep slots of the pool; reset is single-threaded only");
+        if (State* state = get_state()) {
+            state->reset();
+        }
+    }
+
+    using Marker = typename State::Marker;
+
+    // Отметка для rollback(); удобнее через PoolScope
+    Marker checkpoint() const noexcept {
+        static_assert(!ThreadSafe, "thread caches keep slots of the pool; checkpoints are single-threaded only");
+        State* state = get_state();
+        return state ? state->checkpoint() : Marker();
+    }
+
+    void rollback(const Marker& marker) noexcept {
+        static_assert(!ThreadSafe, "thread caches keep slots of the pool; checkpoints are single-threaded only");
+        if (State* state = get_state()) {
+            state->rollback(marker);
         }
     }
 
-    std::shared_ptr<PoolHandle<T>> get_handle() const noexcept {
-        return handle_;
+    // Вернуть источнику (Purge - ядру) простаивающую память пула сверх
+    // keep_bytes, например после спада нагрузки; контейнеры на пуле
+    // остаются рабочими. Возвращает освобожденные байты.
+    size_type trim(size_type keep_bytes = 0, TrimMode mode = TrimMode::Release) const noexcept {
+        State* state = get_state();
+        if (!state) return 0;
+        if constexpr (ThreadSafe) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return state->trim(keep_bytes, mode);
+        } else {
+            return state->trim(keep_bytes, mode);
+        }
+    }
+
+    // Один шаг затухания (PoolState::decay); вызывать периодически
+    size_type decay(std::chrono::steady_clock::duration idle_for,
+                    TrimMode mode = TrimMode::Release) const noexcept {
+        State* state = get_state();
+        if (!state) return 0;
+        auto now = std::chrono::steady_clock::now();
+        if constexpr (ThreadSafe) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return state->decay(idle_for, mode, now);
+        } else {
+            return state->decay(idle_for, mode, now);
+        }
+    }
+
+    // Арена, общая для всех копий и rebind'ов этого аллокатора
+    State* pool() const noexcept {
+        return get_state();
+    }
+
+    // Снимок статистики пула (нули, если сборка без CUSTOMALLOCATOR_STATS)
+    PoolStats stats() const {
+        State* state = get_state();
+        if (!state) return PoolStats();
+        if constexpr (ThreadSafe) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return state->stats();
+        } else {
+            return state->stats();
+        }
     }
 
-    template <typename U, std::size_t C2, bool E2, bool P2>
-    bool operator==(const CustomAllocator<U, C2, E2, P2>& other) const noexcept {
-        return get_state().get() == other.get_state().get();
+    template <typename U, std::size_t C2, bool E2, bool P2, bool S2, typename A2, typename B2, typename O2, typename G2, typename L2>
+    bool operator==(const CustomAllocator<U, C2, E2, P2, S2, A2, B2, O2, G2, L2>& other) const noexcept {
+        return static_cast<const void*>(get_state()) == static_cast<const void*>(other.get_state());
     }
 
-    template <typename U, std::size_t C2, bool E2, bool P2>
-    bool operator!=(const CustomAllocator<U, C2, E2, P2>& other) const noexcept {
+    template <typename U, std::size_t C2, bool E2, bool P2, bool S2, typename A2, typename B2, typename O2, typename G2, typename L2>
+    bool operator!=(const CustomAllocator<U, C2, E2, P2, S2, A2, B2, O2, G2, L2>& other) const noexcept {
         return !(*this == other);
     }
 
 private:
-    template<typename U, std::size_t C, bool E, bool P>
+    template<typename U, std::size_t C, bool E, bool P, bool S, typename A, typename B, typename O, typename G, typename L>
     friend class CustomAllocator;
+};
+
+
+// Область стекового использования пула: при выходе из области все, что
+// выделено в пуле после ее начала, отбрасывается одним откатом.
+// Контейнеры, созданные внутри области, должны быть уничтожены до нее.
+template <typename Allocator>
+class PoolScope {
+public:
+    explicit PoolScope(const Allocator& alloc) noexcept
+        : alloc_(alloc), marker_(alloc_.checkpoint()) {}
+
+    ~PoolScope() {
+        alloc_.rollback(marker_);
+    }
+
+    PoolScope(const PoolScope&) = delete;
+    PoolScope& operator=(const PoolScope&) = delete;
+
+private:
+    Allocator alloc_;
+    typename Allocator::Marker marker_;
 };
\ No newline at end of file
@@ -4,9 +4,32 @@
 #include <algorithm>
 #include <stdexcept>
 #include <memory>
+#include <memory_resource>
 #include <cassert>
+#include <type_traits>
+#include <utility>
 
 
+// Аллокатор умеет расширять выделение на месте:
+// bool try_expand(pointer p, size_t old_n, size_t new_n)
+template <typename Allocator, typename = void>
+struct has_try_expand : std::false_type {};
+
+template <typename Allocator>
+struct has_try_expand<Allocator, std::void_t<decltype(std::declval<Allocator&>().try_expand(
+    std::declval<typename std::allocator_traits<Allocator>::pointer>(), size_t{}, size_t{}))>>
+    : std::true_type {};
+
+// Аллокатор умеет выделять с запасом (как allocate_at_least в C++23):
+// allocation_result allocate_at_least(size_t n) -> {ptr, count}, count >= n
+template <typename Allocator, typename = void>
+struct has_allocate_at_least : std::false_type {};
+
+template <typename Allocator>
+struct has_allocate_at_least<Allocator, std::void_t<decltype(
+    std::declval<Allocator&>().allocate_at_least(size_t{}).count)>>
+    : std::true_type {};
+
 class ReserveProxyObj {
 public:
     ReserveProxyObj(size_t capacity) : capacity_(capacity) {}
@@ -111,11 +134,13 @@ public:
             other.size_ = 0;
             other.capacity_ = 0;
         } else {
-            // Если аллокаторы разные, нужно скопировать элементы
+            // Если аллокаторы разные, переносим элементы поштучно в свою память
             create_storage(other.size_);
-            size_ = other.size_;
+            for (size_t i = 0; i < other.size_; ++i) {
+                alloc_traits::construct(allocator_, items_ + i, std::move_if_noexcept(other.items_[i]));
+                ++size_;
+            }
             capacity_ = other.size_;
-            copy_construct_elements(other.begin(), other.end());
         }
     }
 
@@ -136,13 +161,17 @@ public:
                 }
             }
             
-            SimpleVector tmp(rhs);
+            // Копия строится нашим аллокатором, иначе swap с непропагируемым
+            // аллокатором (например, pmr) получит чужую память
+            SimpleVector tmp(rhs, allocator_);
             swap(tmp);
         }
         return *this;
     }
 
-    SimpleVector& operator=(SimpleVector&& rhs) noexcept {
+    SimpleVector& operator=(SimpleVector&& rhs) noexcept(
+        alloc_traits::propagate_on_container_move_assignment::value ||
+        alloc_traits::is_always_equal::value) {
         if (this != &rhs) {
             // Проверяем, нужно ли копировать аллокатор при перемещении
             if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
@@ -172,8 +201,8 @@ public:
                     rhs.size_ = 0;
                     rhs.capacity_ = 0;
                 } else {
-                    // Аллокаторы разные, нужно скопировать элементы
-                    SimpleVector tmp(std::move(rhs));
+                    // Аллокаторы разные, переносим элементы в память нашего аллокатора
+                    SimpleVector tmp(std::move(rhs), allocator_);
                     swap(tmp);
                 }
             }
@@ -483,7 +512,23 @@ private:
     }
 
     void resize_storage(size_t new_capacity) {
-        Type* new_items = alloc_traits::allocate(allocator_, new_capacity);
+        // Буфер удалось нарастить на месте - элементы переносить не нужно
+        if constexpr (has_try_expand<Allocator>::value) {
+            if (items_ && allocator_.try_expand(items_, capacity_, new_capacity)) {
+                capacity_ = new_capacity;
+                return;
+            }
+        }
+
+        Type* new_items = nullptr;
+        // Если аллокатор дал больше, запоминаем реальную емкость
+        if constexpr (has_allocate_at_least<Allocator>::value) {
+            auto result = allocator_.allocate_at_least(new_capacity);
+            new_items = result.ptr;
+            new_capacity = result.count;
+        } else {
+            new_items = alloc_traits::allocate(allocator_, new_capacity);
+        }
         
         // Перемещаем существующие элементы
         for (size_t i = 0; i < size_; ++i) {
@@ -530,6 +575,11 @@ inline bool operator>=(const SimpleVector<Type, Allocator>& lhs, const SimpleVec
     return !(lhs < rhs);
 }
 
-ReserveProxyObj Reserve(size_t capacity_to_reserve) {
+inline ReserveProxyObj Reserve(size_t capacity_to_reserve) {
     return ReserveProxyObj(capacity_to_reserve);
-}
\ No newline at end of file
+}
+
+// SimpleVector поверх std::pmr: элементы, сами использующие аллокатор,
+// конструируются с ресурсом вектора (uses-allocator construction)
+template <typename Type>
+using PmrSimpleVector = SimpleVector<Type, std::pmr::polymorphic_allocator<Type>>;
\ No newline at end of file
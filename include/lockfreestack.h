@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOCKFREE_NO_TSAN __attribute__((no_sanitize("thread")))
+#else
+#define LOCKFREE_NO_TSAN
+#endif
+
+// Lock-free стек Трайбера для свободных слотов пула.
+// Ссылка на следующий слот хранится в самом слоте, а вершина стека -
+// указатель вместе со счетчиком версий (tag) в одном 64-битном слове.
+// Каждая успешная операция увеличивает tag, поэтому CAS в pop не пройдет,
+// если между чтением вершины и обменом слот успели снять и вернуть (ABA).
+//
+// На 64-битных платформах указатель занимает младшие 48 бит, tag -
+// старшие 16. Это верно для 47-битного пространства пользователя x86-64
+// и AArch64 с 48-битными адресами. С 5-уровневыми таблицами страниц
+// (LA57, 57 бит) Linux выдает адреса выше 47 бит только по явной
+// подсказке mmap; если блок пула все же окажется там, упаковка потеряет
+// старшие биты, и pack() в отладочной сборке остановится на assert.
+// tag в 16 бит защищает от ABA, пока между чтением вершины и CAS проходит
+// меньше 65536 операций над стеком.
+class TaggedFreeStack {
+public:
+    TaggedFreeStack() noexcept = default;
+    TaggedFreeStack(const TaggedFreeStack&) = delete;
+    TaggedFreeStack& operator=(const TaggedFreeStack&) = delete;
+
+    void push(void* p) noexcept {
+        push_chain(p, p);
+    }
+
+    // Положить цепочку first -> ... -> last, уже связанную через store_next
+    void push_chain(void* first, void* last) noexcept {
+        std::uint64_t old = head_.load(std::memory_order_relaxed);
+        do {
+            store_next(last, ptr(old));
+        } while (!head_.compare_exchange_weak(old, pack(first, tag(old) + 1),
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+    }
+
+    void* pop() noexcept {
+        std::uint64_t old = head_.load(std::memory_order_acquire);
+        while (void* top = ptr(old)) {
+            void* next = peek_next(top);
+            if (head_.compare_exchange_weak(old, pack(next, tag(old) + 1),
+                                            std::memory_order_acquire,
+                                            std::memory_order_acquire)) {
+                return top;
+            }
+        }
+        return nullptr;
+    }
+
+    bool empty() const noexcept {
+        return ptr(head_.load(std::memory_order_relaxed)) == nullptr;
+    }
+
+    void clear() noexcept {
+        head_.store(0, std::memory_order_relaxed);
+    }
+
+    static void store_next(void* slot, void* next) noexcept {
+        std::memcpy(slot, &next, sizeof(void*));
+    }
+
+private:
+    static_assert(sizeof(void*) <= 8, "tagged pointer needs at most 64-bit addresses");
+
+    static constexpr unsigned tag_shift = sizeof(void*) == 8 ? 48 : 32;
+    static constexpr std::uint64_t ptr_mask = (std::uint64_t(1) << tag_shift) - 1;
+
+    // Вершину мог уже снять и переписать другой поток. Прочитанное тогда
+    // значение мусорное, но память блока жива до смерти пула, а CAS
+    // отвергнет его по tag. Если CAS прошел, слот все это время лежал
+    // в стеке и его ссылку никто не менял. Гонка ожидаемая - скрываем от TSan.
+    LOCKFREE_NO_TSAN static void* peek_next(void* slot) noexcept {
+        void* next;
+        std::memcpy(&next, slot, sizeof(void*));
+        return next;
+    }
+
+    static std::uint64_t pack(void* p, std::uint64_t t) noexcept {
+        auto bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p));
+        assert((bits & ~ptr_mask) == 0 && "TaggedFreeStack: address does not fit below the tag bits");
+        return bits | (t << tag_shift);
+    }
+
+    static void* ptr(std::uint64_t v) noexcept {
+        return reinterpret_cast<void*>(static_cast<std::uintptr_t>(v & ptr_mask));
+    }
+
+    static std::uint64_t tag(std::uint64_t v) noexcept {
+        return v >> tag_shift;
+    }
+
+    std::atomic<std::uint64_t> head_{0};
+};
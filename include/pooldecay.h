@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "customallocator.h"
+
+// Фоновое затухание пулов: поток раз в period вызывает decay() у всех
+// наблюдаемых аллокаторов. Поток трогает пулы параллельно с их
+// владельцами: ThreadSafe-пул защищает свой mutex, однопоточный - mutex
+// владельца, под которым тот работает с пулом (и с reset()). Поток держит
+// копии аллокаторов, так что их пулы живут не меньше него.
+class PoolDecayThread {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit PoolDecayThread(clock::duration period)
+        : period_(period),
+          thread_([this] { run(); }) {}
+
+    ~PoolDecayThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    PoolDecayThread(const PoolDecayThread&) = delete;
+    PoolDecayThread& operator=(const PoolDecayThread&) = delete;
+
+    // Возвращать память пула alloc, простоявшую без дела не меньше idle_for
+    template <typename Allocator>
+    void watch(const Allocator& alloc, clock::duration idle_for, TrimMode mode = TrimMode::Release) {
+        static_assert(Allocator::State::concurrent, "background decay needs a thread-safe pool");
+        std::lock_guard<std::mutex> lock(mutex_);
+        pools_.push_back([alloc, idle_for, mode] { return alloc.decay(idle_for, mode); });
+    }
+
+    template <typename Allocator>
+    void watch(const Allocator& alloc, std::mutex& guard, clock::duration idle_for,
+               TrimMode mode = TrimMode::Release) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pools_.push_back([alloc, &guard, idle_for, mode] {
+            std::lock_guard<std::mutex> pool_lock(guard);
+            return alloc.decay(idle_for, mode);
+        });
+    }
+
+    // Сколько байт вернули все проходы
+    std::size_t released() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return released_;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!wake_.wait_for(lock, period_, [this] { return stop_; })) {
+            for (auto& decay : pools_) {
+                released_ += decay();
+            }
+        }
+    }
+
+    const clock::duration period_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::vector<std::function<std::size_t()>> pools_;
+    std::size_t released_ = 0;
+    // Последним: поток стартует, когда остальные поля уже готовы
+    std::thread thread_;
+};
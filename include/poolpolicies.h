@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Политики выравнивания памяти пула.
+// block - выравнивание начала каждого блока (0 - естественное, alignof(T)),
+// slot  - выравнивание начала каждого выделения внутри блока (0 - без доп. выравнивания).
+
+// Выравнивать только блоки, например по кэш-линии
+template <std::size_t Align = 0>
+struct AlignBlocks {
+    static_assert((Align & (Align - 1)) == 0, "alignment must be a power of two");
+
+    static constexpr std::size_t block = Align;
+    static constexpr std::size_t slot = 0;
+};
+
+// Выравнивать каждое выделение: соседние узлы не делят кэш-линию
+template <std::size_t Align>
+struct AlignSlots {
+    static_assert(Align > 0 && (Align & (Align - 1)) == 0, "alignment must be a power of two");
+
+    static constexpr std::size_t block = Align;
+    static constexpr std::size_t slot = Align;
+};
+
+using NaturalAlign = AlignBlocks<0>;
+
+constexpr std::size_t cache_line_size = 64;
+
+// Политики роста: размер очередного блока пула в байтах.
+//   static std::size_t next_block(std::size_t need, std::size_t chunk, std::size_t last);
+// need  - сколько байт нужно текущему запросу (результат не меньше),
+// chunk - базовый размер блока: ChunkElems элементов запрашивающего типа,
+// last  - размер предыдущего блока (0, если блоков еще нет).
+
+// Все блоки по chunk: прежнее поведение
+struct FixedGrowth {
+    static std::size_t next_block(std::size_t need, std::size_t chunk, std::size_t) noexcept {
+        return need > chunk ? need : chunk;
+    }
+};
+
+// Каждый блок в Factor раз больше предыдущего, но не больше CapBytes:
+// число блоков растет логарифмически от объема пула
+template <std::size_t Factor = 2, std::size_t CapBytes = (std::size_t(1) << 20)>
+struct GeometricGrowth {
+    static_assert(Factor >= 1, "growth factor must be positive");
+
+    static std::size_t next_block(std::size_t need, std::size_t chunk, std::size_t last) noexcept {
+        std::size_t size = chunk;
+        if (last > 0 && last <= CapBytes / Factor) {
+            size = last * Factor > chunk ? last * Factor : chunk;
+        } else if (last > 0) {
+            size = CapBytes > chunk ? CapBytes : chunk;
+        }
+        return need > size ? need : size;
+    }
+};
+
+// Блоки фиксированного размера в байтах независимо от ChunkElems
+template <std::size_t Bytes = (std::size_t(64) << 10)>
+struct ByteTargetGrowth {
+    static std::size_t next_block(std::size_t need, std::size_t, std::size_t) noexcept {
+        return need > Bytes ? need : Bytes;
+    }
+};
+
+// Политики хранения одиночных слотов при PerElementFree.
+
+// Освобожденный слот - в LIFO-список своего размера, слоты режутся из
+// общих блоков пула: быстрее всего, но блоки не возвращаются источнику
+// до уничтожения пула, даже если все слоты свободны
+struct FreeListSlots {
+    static constexpr bool slabs = false;
+    static constexpr std::size_t spare = 0;
+};
+
+// Слоты одного размера - в отдельных блоках (slab'ах) с битовой картой
+// занятости и счетчиком живых слотов. Опустевший slab возвращается
+// источнику; до Spare пустых slab'ов каждого размера остаются про запас,
+// чтобы колебания около границы slab'а не гоняли память туда-обратно.
+// Slab выровнен по своему размеру (степень двойки), поэтому источник
+// должен поддерживать такое выравнивание. Только без ThreadSafe.
+template <std::size_t Spare = 1>
+struct BitmapSlabs {
+    static constexpr bool slabs = true;
+    static constexpr std::size_t spare = Spare;
+};
+
+// Политики владения пулом. Аллокатор хранит holder и на горячем пути
+// обращается к пулу через get() - обычный указатель без изменения счетчика;
+// счетчик трогают только копирование и уничтожение аллокатора.
+
+// std::shared_ptr с атомарным счетчиком: копии аллокатора можно
+// уничтожать в любых потоках. Обязательна для ThreadSafe.
+struct SharedOwnership {
+    template <typename State>
+    class holder {
+    public:
+        holder() noexcept = default;
+
+        template <typename... Args>
+        static holder make(Args&&... args) {
+            holder h;
+            h.ptr_ = std::make_shared<State>(std::forward<Args>(args)...);
+            return h;
+        }
+
+        State* get() const noexcept {
+            return ptr_.get();
+        }
+
+        const std::shared_ptr<State>& shared() const noexcept {
+            return ptr_;
+        }
+
+    private:
+        std::shared_ptr<State> ptr_;
+    };
+};
+
+// Интрузивный неатомарный счетчик для однопоточного использования:
+// все копии аллокатора одного пула должны жить в одном потоке
+struct LocalOwnership {
+    template <typename State>
+    class holder {
+    public:
+        holder() noexcept = default;
+
+        template <typename... Args>
+        static holder make(Args&&... args) {
+            holder h;
+            h.node_ = new Node(std::forward<Args>(args)...);
+            return h;
+        }
+
+        holder(const holder& other) noexcept : node_(other.node_) {
+            if (node_) ++node_->refs;
+        }
+
+        holder(holder&& other) noexcept : node_(std::exchange(other.node_, nullptr)) {}
+
+        holder& operator=(holder other) noexcept {
+            std::swap(node_, other.node_);
+            return *this;
+        }
+
+        ~holder() {
+            if (node_ && --node_->refs == 0) {
+                delete node_;
+            }
+        }
+
+        State* get() const noexcept {
+            return node_ ? &node_->state : nullptr;
+        }
+
+    private:
+        struct Node {
+            template <typename... Args>
+            explicit Node(Args&&... args) : state(std::forward<Args>(args)...) {}
+
+            std::size_t refs = 1;
+            State state;
+        };
+
+        Node* node_ = nullptr;
+    };
+};
+
+// Пул принадлежит вызывающему (например, FixedPool) и должен пережить все
+// копии аллокатора; аллокатор только ссылается на него, без счетчика и
+// без обращений к куче. Аллокатор создается от готового пула.
+struct BorrowedOwnership {
+    template <typename State>
+    class holder {
+    public:
+        holder() noexcept = default;
+
+        static holder make(State& state) noexcept {
+            holder h;
+            h.ptr_ = &state;
+            return h;
+        }
+
+        State* get() const noexcept {
+            return ptr_;
+        }
+
+    private:
+        State* ptr_ = nullptr;
+    };
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <optional>
+
+#include "customallocator.h"
+
+// std::pmr::memory_resource поверх PoolState - той же арены, что у
+// CustomAllocator. Мелкие запросы (до max_small_bytes с выравниванием до
+// max_small_align) занимают слоты пула, как одиночные элементы
+// PerElementFree: свободные списки или slab'ы. Остальные - span'ы из корзин
+// и bump-блоков, а крупнее порога пула - отдельные блоки источника.
+// Ресурс владеет своим пулом или работает поверх чужого, например пула
+// CustomAllocator (*alloc.pool()): тогда pmr-контейнеры и контейнеры с
+// CustomAllocator живут в одной арене и освобождаются вместе с ней.
+// Как и std::pmr::unsynchronized_pool_resource, не потокобезопасен.
+template <typename State = PoolState<>>
+class PoolResource : public std::pmr::memory_resource {
+public:
+    using size_type = std::size_t;
+    using Source = typename State::source_type;
+
+    static constexpr size_type max_small_bytes = State::max_slot_bytes;
+    static constexpr size_type max_small_align = State::max_slot_align;
+    static constexpr size_type default_chunk_bytes = size_type(64) << 10;
+
+    static_assert(!State::concurrent, "PoolResource needs a single-threaded pool");
+
+    // Собственный пул с блоками от chunk_bytes байт
+    explicit PoolResource(size_type chunk_bytes = default_chunk_bytes,
+                          const Source& source = Source())
+        : own_(std::in_place, chunk_bytes, source),
+          state_(&*own_),
+          unit_(1) {}
+
+    explicit PoolResource(const Source& source)
+        : PoolResource(default_chunk_bytes, source) {}
+
+    // Поверх чужого пула, который переживает ресурс и все выделения из него.
+    // Новые блоки ресурс берет того же размера, что и владелец пула
+    explicit PoolResource(State& state) noexcept
+        : state_(&state),
+          unit_(state.largest_slot ? state.largest_slot : 1) {}
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    // Вернуть источнику все блоки собственного пула, включая еще не
+    // освобожденные выделения. Чужой пул освобождает его владелец
+    void release() noexcept {
+        if (own_) {
+            own_->release_all_blocks();
+        }
+    }
+
+    State* pool() const noexcept {
+        return state_;
+    }
+
+protected:
+    void* do_allocate(size_type bytes, size_type align) override {
+        if (bytes == 0) {
+            bytes = 1;
+        }
+        void* p = nullptr;
+        if (is_small(bytes, align)) {
+            size_type slot = slot_size(bytes, align);
+            if constexpr (State::slabs) {
+                p = state_->slab_allocate(slot);
+            } else {
+                p = state_->pop_free(slot);
+                if (!p) {
+                    p = state_->allocate_bytes(slot, State::slot_align(slot), unit_, true);
+                }
+            }
+        } else if (state_->is_large(bytes, unit_)) {
+            p = state_->allocate_large(bytes, align);
+        } else {
+            p = state_->allocate_bytes(bytes, align, unit_, true);
+        }
+        POOL_STATS(state_->counters.on_allocate(bytes));
+        POOL_TRACE(trace_event(TraceOp::Allocate, state_, p, 1, bytes));
+        return p;
+    }
+
+    void do_deallocate(void* p, size_type bytes, size_type align) override {
+        if (!p) return;
+        if (bytes == 0) {
+            bytes = 1;
+        }
+        POOL_TRACE(trace_event(TraceOp::Deallocate, state_, p, 1, bytes));
+        assert(state_->owns(p) && "deallocate: pointer does not belong to this pool");
+        if (is_small(bytes, align)) {
+            size_type slot = slot_size(bytes, align);
+            if constexpr (State::slabs) {
+                state_->slab_deallocate(p, slot);
+            } else {
+                state_->push_free(p, slot);
+            }
+        } else if (auto* large = state_->find_large(p)) {
+            state_->free_large(large);
+        } else {
+            state_->push_span(p, bytes);
+        }
+        POOL_STATS(state_->counters.on_reclaim(bytes));
+    }
+
+    // Ресурсы поверх одного пула взаимозаменяемы
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        if (this == &other) return true;
+        auto* pool = dynamic_cast<const PoolResource*>(&other);
+        return pool && pool->state_ == state_;
+    }
+
+private:
+    static bool is_small(size_type bytes, size_type align) noexcept {
+        return bytes <= max_small_bytes && align <= max_small_align;
+    }
+
+    // Слот кратен выравниванию запроса, а слоты одного размера пул
+    // выравнивает по младшему биту размера: переиспользованный слот
+    // годится любому запросу этого размера, в том числе от CustomAllocator
+    static size_type slot_size(size_type bytes, size_type align) noexcept {
+        size_type unit = align > State::granularity ? align : State::granularity;
+        return State::round_up(bytes > sizeof(void*) ? bytes : sizeof(void*), unit);
+    }
+
+    std::optional<State> own_;
+    State* state_;
+    // Размер элемента для политики роста и порога крупных выделений пула
+    size_type unit_;
+};
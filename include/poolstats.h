@@ -0,0 +1,203 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+// Статистика пула включается при сборке: -DCUSTOMALLOCATOR_STATS=1
+// (в CMake - опция ALLOCATOR_STATS). Без нее счетчиков в PoolState нет,
+// а хуки POOL_STATS(...) не генерируют кода.
+#ifndef CUSTOMALLOCATOR_STATS
+#define CUSTOMALLOCATOR_STATS 0
+#endif
+
+#if CUSTOMALLOCATOR_STATS
+#define POOL_STATS(expr) (expr)
+#else
+#define POOL_STATS(expr) ((void)0)
+#endif
+
+// Снимок счетчиков пула. При выключенной статистике все поля нулевые.
+struct PoolStats {
+    static constexpr bool enabled = CUSTOMALLOCATOR_STATS != 0;
+
+    std::size_t bytes_reserved = 0;   // взято у источника блоков
+    std::size_t bytes_allocated = 0;  // выдано пользователям за все время
+    std::size_t bytes_reclaimed = 0;  // возвращено пользователями для повторного использования
+    std::size_t bytes_in_use = 0;     // выдано и еще не возвращено
+    std::size_t high_water = 0;       // максимум bytes_in_use
+    std::size_t free_list_length = 0; // свободных слотов и span'ов в пуле
+    std::size_t blocks = 0;           // блоков сейчас
+    std::size_t large_blocks = 0;     // из них отдельных блоков крупных выделений
+    std::size_t tail_waste = 0;       // брошенные хвосты блоков при переходе к новому
+    std::size_t tail_recycled = 0;    // хвосты блоков, ушедшие в корзины span'ов
+    std::size_t bytes_released = 0;   // возвращено источнику через trim()/decay()
+    std::size_t bytes_purged = 0;     // отдано ядру (madvise) через trim()/decay()
+};
+
+inline std::string to_json(const PoolStats& s) {
+    std::string out = "{";
+    auto field = [&out](const char* name, std::size_t value, bool last = false) {
+        out += '"';
+        out += name;
+        out += "\": ";
+        out += std::to_string(value);
+        if (!last) out += ", ";
+    };
+    field("bytes_reserved", s.bytes_reserved);
+    field("bytes_allocated", s.bytes_allocated);
+    field("bytes_reclaimed", s.bytes_reclaimed);
+    field("bytes_in_use", s.bytes_in_use);
+    field("high_water", s.high_water);
+    field("free_list_length", s.free_list_length);
+    field("blocks", s.blocks);
+    field("large_blocks", s.large_blocks);
+    field("tail_waste", s.tail_waste);
+    field("tail_recycled", s.tail_recycled);
+    field("bytes_released", s.bytes_released);
+    field("bytes_purged", s.bytes_purged, true);
+    out += '}';
+    return out;
+}
+
+// Счетчики внутри PoolState. В конкурентном пуле слоты выдаются кэшами
+// потоков без мьютекса, поэтому счетчики атомарные (relaxed).
+template <bool Concurrent>
+class PoolCounters {
+public:
+    using size_type = std::size_t;
+
+    void on_block(size_type bytes) noexcept {
+        add(blocks_, 1);
+        add(reserved_, bytes);
+    }
+
+    // Отдельный блок крупного выделения взят и возвращен источнику
+    void on_large_block(size_type bytes) noexcept {
+        on_block(bytes);
+        add(large_blocks_, 1);
+    }
+
+    void on_large_release(size_type bytes) noexcept {
+        on_block_free(bytes);
+        sub(large_blocks_, 1);
+    }
+
+    // Блок вернулся источнику до уничтожения пула
+    void on_block_free(size_type bytes) noexcept {
+        sub(blocks_, 1);
+        sub(reserved_, bytes);
+    }
+
+    void on_release() noexcept {
+        set(blocks_, 0);
+        set(reserved_, 0);
+        set(in_use_, 0);
+        set(free_slots_, 0);
+    }
+
+    void on_reset() noexcept {
+        set(in_use_, 0);
+        set(free_slots_, 0);
+    }
+
+    void on_rollback(size_type in_use) noexcept {
+        set(in_use_, in_use);
+        set(free_slots_, 0);
+    }
+
+    size_type in_use() const noexcept {
+        return get(in_use_);
+    }
+
+    void on_allocate(size_type bytes) noexcept {
+        add(allocated_, bytes);
+        size_type use = add(in_use_, bytes);
+        raise(high_water_, use);
+    }
+
+    void on_reclaim(size_type bytes) noexcept {
+        add(reclaimed_, bytes);
+        sub(in_use_, bytes);
+    }
+
+    void on_free_push(size_type count) noexcept {
+        add(free_slots_, count);
+    }
+
+    void on_free_pop(size_type count) noexcept {
+        sub(free_slots_, count);
+    }
+
+    void on_tail_waste(size_type bytes) noexcept {
+        add(tail_waste_, bytes);
+    }
+
+    void on_tail_recycled(size_type bytes) noexcept {
+        add(tail_recycled_, bytes);
+    }
+
+    void on_trim(size_type bytes, bool purged) noexcept {
+        add(purged ? purged_ : released_, bytes);
+    }
+
+    PoolStats snapshot(size_type span_count) const noexcept {
+        PoolStats s;
+        s.bytes_reserved = get(reserved_);
+        s.bytes_allocated = get(allocated_);
+        s.bytes_reclaimed = get(reclaimed_);
+        s.bytes_in_use = get(in_use_);
+        s.high_water = get(high_water_);
+        s.free_list_length = get(free_slots_) + span_count;
+        s.blocks = get(blocks_);
+        s.large_blocks = get(large_blocks_);
+        s.tail_waste = get(tail_waste_);
+        s.tail_recycled = get(tail_recycled_);
+        s.bytes_released = get(released_);
+        s.bytes_purged = get(purged_);
+        return s;
+    }
+
+private:
+    using counter = std::conditional_t<Concurrent, std::atomic<size_type>, size_type>;
+
+    static size_type add(size_type& c, size_type v) noexcept { return c += v; }
+    static size_type sub(size_type& c, size_type v) noexcept { return c -= v; }
+    static void set(size_type& c, size_type v) noexcept { c = v; }
+    static size_type get(const size_type& c) noexcept { return c; }
+    static void raise(size_type& c, size_type v) noexcept {
+        if (v > c) c = v;
+    }
+
+    static size_type add(std::atomic<size_type>& c, size_type v) noexcept {
+        return c.fetch_add(v, std::memory_order_relaxed) + v;
+    }
+    static size_type sub(std::atomic<size_type>& c, size_type v) noexcept {
+        return c.fetch_sub(v, std::memory_order_relaxed) - v;
+    }
+    static void set(std::atomic<size_type>& c, size_type v) noexcept {
+        c.store(v, std::memory_order_relaxed);
+    }
+    static size_type get(const std::atomic<size_type>& c) noexcept {
+        return c.load(std::memory_order_relaxed);
+    }
+    static void raise(std::atomic<size_type>& c, size_type v) noexcept {
+        size_type cur = c.load(std::memory_order_relaxed);
+        while (v > cur && !c.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    counter reserved_{0};
+    counter allocated_{0};
+    counter reclaimed_{0};
+    counter in_use_{0};
+    counter high_water_{0};
+    counter free_slots_{0};
+    counter blocks_{0};
+    counter large_blocks_{0};
+    counter tail_waste_{0};
+    counter tail_recycled_{0};
+    counter released_{0};
+    counter purged_{0};
+};
\ No newline at end of file
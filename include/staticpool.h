@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+#include "customallocator.h"
+
+// Пул фиксированной емкости в памяти вызывающего. Состояние пула лежит в
+// самом объекте, весь буфер - один блок пула с заголовком в его начале,
+// так что ни создание пула, ни выделения не обращаются к куче. Пул не
+// растет: выделение за пределами буфера - std::bad_alloc. Выделение -
+// свободный список, корзины span'ов или bump-указатель. Поиск в корзинах
+// ограничен span_probes span'ами своего класса и верхними span'ами
+// старших, поэтому время выделения не растет с числом выделений.
+// Аллокаторы из allocator() только ссылаются на пул и не должны его
+// пережить; ThreadSafe и BitmapSlabs здесь недоступны.
+template <typename T, bool PerElementFree = false, typename AlignPolicy = NaturalAlign>
+class FixedPool {
+public:
+    // ChunkElems шаблона не используется: емкость в элементах задает буфер
+    using allocator_type = CustomAllocator<T, 1, false, PerElementFree, false, AlignPolicy,
+                                           StaticBufferSource, BorrowedOwnership>;
+    using State = typename allocator_type::State;
+    using size_type = std::size_t;
+
+    FixedPool(void* buffer, size_type bytes)
+        : FixedPool(buffer, bytes, block_capacity(buffer, bytes)) {}
+
+    template <typename Byte, std::size_t N>
+    explicit FixedPool(std::array<Byte, N>& buffer)
+        : FixedPool(buffer.data(), sizeof(buffer)) {}
+
+    template <typename Byte, std::size_t N>
+    explicit FixedPool(Byte (&buffer)[N])
+        : FixedPool(buffer, sizeof(buffer)) {}
+
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+
+    allocator_type allocator() noexcept {
+        return allocator_type(state_);
+    }
+
+    // Полезная емкость буфера за вычетом заголовка блока
+    size_type capacity() const noexcept {
+        return state_.capacity_bytes;
+    }
+
+private:
+    FixedPool(void* buffer, size_type bytes, size_type usable)
+        : arena_(buffer, bytes),
+          state_(usable / sizeof(T) > 0 ? usable / sizeof(T) : 1, StaticBufferSource(arena_))
+    {
+        // Единственный блок на весь буфер; дальше выделения только режут его
+        state_.reserve_bytes(usable);
+    }
+
+    // Полезные байты блока, занимающего буфер с выровненного начала
+    static size_type block_capacity(void* buffer, size_type bytes) {
+        size_type space = bytes;
+        if (!std::align(State::block_align, State::header_bytes + 1, buffer, space)) {
+            throw std::invalid_argument("buffer is too small for a pool block");
+        }
+        return space - State::header_bytes;
+    }
+
+    StaticArena arena_;
+    State state_;
+};
+
+// Буфер FixedPool внутри объекта, выровненный под блок пула
+template <std::size_t Bytes, std::size_t Align>
+struct InlineBuffer {
+    alignas(Align) std::byte bytes[Bytes];
+};
+
+// FixedPool вместе со своим буфером из Bytes байт: можно разместить
+// статически, на стеке или внутри другого объекта
+template <typename T, std::size_t Bytes, bool PerElementFree = false, typename AlignPolicy = NaturalAlign>
+class StaticPool
+    : private InlineBuffer<Bytes, FixedPool<T, PerElementFree, AlignPolicy>::State::block_align>,
+      public FixedPool<T, PerElementFree, AlignPolicy> {
+    using Buffer = InlineBuffer<Bytes, FixedPool<T, PerElementFree, AlignPolicy>::State::block_align>;
+
+public:
+    static_assert(Bytes > FixedPool<T, PerElementFree, AlignPolicy>::State::header_bytes,
+                  "static pool must fit its block header");
+
+    StaticPool()
+        : FixedPool<T, PerElementFree, AlignPolicy>(Buffer::bytes, Bytes) {}
+};
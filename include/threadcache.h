@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <new>
+#include <algorithm>
+
+#include "lockfreestack.h"
+#include "poolstats.h"
+
+// Локальный кэш потока для потокобезопасного CustomAllocator.
+// Для каждого пула поток держит магазин свободных слотов и участок
+// bump-памяти. Слоты обмениваются с общим lock-free стеком PoolState пачками
+// без блокировок; мьютекс захватывается только при нарезке новой bump-памяти.
+// Выделение и освобождение одиночного элемента мьютекс не захватывают.
+// State - конкурентный PoolState, которым владеет аллокатор, T - тип элемента.
+template <typename State, typename T, bool Expandable, bool PerElementFree>
+class ThreadCache {
+public:
+    using size_type = std::size_t;
+
+    static constexpr size_type magazine_size = 64;
+
+    // Размер и выравнивание слота, который кэш выдает за один allocate(1)
+    static constexpr size_type slot =
+        PerElementFree ? State::template slot_size<T>()
+                       : State::round_up(sizeof(T), State::template elem_align<T>());
+    static constexpr size_type slot_align =
+        PerElementFree ? State::slot_align(slot) : State::template elem_align<T>();
+
+    static ThreadCache& local() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    ThreadCache() = default;
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    // При завершении потока возвращаем все закэшированное в живые пулы
+    ~ThreadCache() {
+        for (auto& m : magazines_) {
+            if (auto state = m->owner.lock()) {
+                flush(*m, *state, 0);
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->push_span(m->bump_cur, m->bump_left);
+            }
+        }
+    }
+
+    void* allocate(const std::shared_ptr<State>& state) {
+        Magazine& m = magazine_for(state);
+        if (m.count > 0) {
+            return m.slots[--m.count];
+        }
+
+        if (m.bump_left < slot) {
+            refill(m, *state);
+            if (m.count > 0) {
+                return m.slots[--m.count];
+            }
+        }
+
+        void* p = m.bump_cur;
+        m.bump_cur += slot;
+        m.bump_left -= slot;
+        return p;
+    }
+
+    void deallocate(const std::shared_ptr<State>& state, void* p) noexcept {
+        Magazine* m = nullptr;
+        try {
+            m = &magazine_for(state);
+        } catch (...) {
+            push_free(*state, p);
+            return;
+        }
+
+        if (m->count == magazine_size) {
+            flush(*m, *state, magazine_size / 2);
+        }
+        m->slots[m->count++] = p;
+    }
+
+private:
+    struct Magazine {
+        std::weak_ptr<State> owner;
+        std::array<void*, magazine_size> slots;
+        size_type count = 0;
+        char* bump_cur = nullptr;
+        size_type bump_left = 0;
+    };
+
+    // weak_ptr держит control block, поэтому сравнение по владельцу
+    // не может спутать живой пул с новым пулом по тому же адресу
+    static bool same_owner(const Magazine& m, const std::shared_ptr<State>& state) noexcept {
+        return !m.owner.owner_before(state) && !state.owner_before(m.owner);
+    }
+
+    Magazine& magazine_for(const std::shared_ptr<State>& state) {
+        if (last_ && same_owner(*last_, state)) {
+            return *last_;
+        }
+
+        for (auto it = magazines_.begin(); it != magazines_.end();) {
+            if (same_owner(**it, state)) {
+                last_ = it->get();
+                return *last_;
+            }
+            // Пул уже уничтожен вместе со всей своей памятью
+            if ((*it)->owner.expired()) {
+                it = magazines_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto m = std::make_unique<Magazine>();
+        m->owner = state;
+        magazines_.push_back(std::move(m));
+        last_ = magazines_.back().get();
+        return *last_;
+    }
+
+    void refill(Magazine& m, State& state) {
+        if constexpr (PerElementFree) {
+            while (m.count < magazine_size / 2) {
+                void* p = pop_free(state);
+                if (!p) break;
+                m.slots[m.count++] = p;
+            }
+            if (m.count > 0) return;
+        }
+
+        size_type batch = state.chunk_elems;
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.push_span(m.bump_cur, m.bump_left);
+        m.bump_cur = nullptr;
+        m.bump_left = 0;
+
+        void* run = nullptr;
+        try {
+            run = state.allocate_bytes(batch * slot, slot_align, slot, Expandable);
+        } catch (const std::bad_alloc&) {
+            if (batch == 1) throw;
+            batch = 1;
+            run = state.allocate_bytes(slot, slot_align, slot, Expandable);
+        }
+        m.bump_cur = static_cast<char*>(run);
+        m.bump_left = batch * slot;
+    }
+
+    // Слоты крупнее max_slot_bytes лежат в корзинах span'ов под мьютексом
+    static void push_free(State& state, void* p) noexcept {
+        if constexpr (State::has_free_list(slot)) {
+            state.push_free(p, slot);
+        } else {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.push_free(p, slot);
+        }
+    }
+
+    static void* pop_free(State& state) noexcept {
+        if constexpr (State::has_free_list(slot)) {
+            return state.pop_free(slot);
+        } else {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            return state.pop_free(slot);
+        }
+    }
+
+    // Вернуть в общий стек все слоты магазина сверх keep одной цепочкой
+    void flush(Magazine& m, State& state, size_type keep) noexcept {
+        if (m.count <= keep) return;
+        if constexpr (State::has_free_list(slot)) {
+            for (size_type i = keep; i + 1 < m.count; ++i) {
+                TaggedFreeStack::store_next(m.slots[i], m.slots[i + 1]);
+            }
+            state.free_list(slot).push_chain(m.slots[keep], m.slots[m.count - 1]);
+            POOL_STATS(state.counters.on_free_push(m.count - keep));
+            m.count = keep;
+        } else {
+            while (m.count > keep) {
+                push_free(state, m.slots[--m.count]);
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Magazine>> magazines_;
+    Magazine* last_ = nullptr;
+};
@@ -7,6 +7,13 @@ constexpr int chunkElems = 10;
 int main() {
 
     try {
+		// Трасса выделений для allocator_replay (сборка с ALLOCATOR_TRACE)
+		std::unique_ptr<TraceRecorder> trace;
+		if (const char* path = std::getenv("ALLOCATOR_TRACE")) {
+			trace = std::make_unique<TraceRecorder>(path);
+			trace->start();
+		}
+
     	using Pair = std::pair<const int, int>;
 
 		std::map<int, int> map;
@@ -15,6 +22,7 @@ int main() {
 		}
 
 		std::map<int, int, std::less<int>, CustomAllocator<Pair, chunkElems>> mapAlloc;
+		mapAlloc.get_allocator().reserve_elements(chunkElems);
 		for(int i = 0; i < chunkElems; ++i) {
 			mapAlloc.emplace(i, custmath::factorial(i));
 		}
@@ -23,6 +31,10 @@ int main() {
 			std::cout << number << " " << factorial << std::endl;
 		}
 
+		if constexpr (PoolStats::enabled) {
+			std::cerr << to_json(mapAlloc.get_allocator().stats()) << std::endl;
+		}
+
 		SimpleVector<int> vector;
 		for(int i = 0; i < chunkElems; ++i) {
 			vector.PushBack(i);
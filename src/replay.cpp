@@ -0,0 +1,345 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "customallocator.h"
+#include "customvector.h"
+#include "allocationtrace.h"
+
+// Воспроизведение трассы, записанной TraceRecorder, на разных конфигурациях
+// аллокатора. Каждый пул трассы получает свой аллокатор конфигурации, а
+// выделения с разным sizeof(T) идут через его rebind'ы, как в исходной
+// программе. Размер элемента округляется до 1, 2, 4 или кратного 8 байт;
+// элементы крупнее max_unit_bytes воспроизводятся блоками по 8 байт.
+//
+// Отчет: время прогона, пик памяти, взятой у источника блоков, пик живых
+// выделений и фрагментация 1 - peak live / peak reserved: доля взятой
+// памяти, которая на пике не была занята выделениями.
+
+namespace {
+
+// Память, которую конфигурации берут у источника блоков (или у operator new)
+struct MemoryMeter {
+    std::size_t reserved = 0;
+    std::size_t peak_reserved = 0;
+    std::size_t live = 0;
+    std::size_t peak_live = 0;
+
+    void take(std::size_t bytes) {
+        reserved += bytes;
+        if (reserved > peak_reserved) {
+            peak_reserved = reserved;
+        }
+    }
+
+    void give(std::size_t bytes) {
+        reserved -= bytes;
+    }
+};
+
+MemoryMeter meter;
+
+struct MeteredBlockSource {
+    void* allocate(std::size_t bytes, std::size_t align) noexcept {
+        void* p = NewBlockSource().allocate(bytes, align);
+        if (p) meter.take(bytes);
+        return p;
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t align) noexcept {
+        meter.give(bytes);
+        NewBlockSource().deallocate(p, bytes, align);
+    }
+};
+
+// std::allocator с учетом взятой памяти - точка отсчета
+template <typename T>
+struct MeteredStdAllocator {
+    using value_type = T;
+
+    MeteredStdAllocator() noexcept = default;
+    template <typename U>
+    MeteredStdAllocator(const MeteredStdAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        meter.take(n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        meter.give(n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const MeteredStdAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const MeteredStdAllocator<U>&) const noexcept { return false; }
+};
+
+constexpr std::size_t max_unit_bytes = 512;
+// 1, 2, 4, затем 8, 16, ..., max_unit_bytes
+constexpr std::size_t unit_kinds = 3 + max_unit_bytes / 8;
+
+constexpr std::size_t unit_size(std::size_t kind) {
+    return kind < 3 ? (std::size_t(1) << kind) : (kind - 2) * 8;
+}
+
+std::size_t unit_kind(std::size_t elem_size) {
+    if (elem_size <= 1) return 0;
+    if (elem_size <= 2) return 1;
+    if (elem_size <= 4) return 2;
+    return 2 + (elem_size + 7) / 8;
+}
+
+template <std::size_t Size>
+struct alignas(Size < 8 ? Size : 8) Unit {
+    unsigned char bytes[Size];
+};
+
+// Rebind корневого аллокатора пула на Unit<Size>
+class UnitAllocatorBase {
+public:
+    virtual ~UnitAllocatorBase() = default;
+    virtual void* allocate(std::size_t n) = 0;
+    virtual void deallocate(void* p, std::size_t n) = 0;
+    virtual bool try_expand(void* p, std::size_t old_n, std::size_t new_n) = 0;
+};
+
+template <typename Alloc, std::size_t Size>
+class UnitAllocator : public UnitAllocatorBase {
+public:
+    using Rebound = typename std::allocator_traits<Alloc>::template rebind_alloc<Unit<Size>>;
+    using Traits = std::allocator_traits<Rebound>;
+
+    explicit UnitAllocator(const Alloc& root) : alloc_(root) {}
+
+    void* allocate(std::size_t n) override {
+        return Traits::allocate(alloc_, n);
+    }
+
+    void deallocate(void* p, std::size_t n) override {
+        Traits::deallocate(alloc_, static_cast<Unit<Size>*>(p), n);
+    }
+
+    bool try_expand(void* p, std::size_t old_n, std::size_t new_n) override {
+        if constexpr (has_try_expand<Rebound>::value) {
+            return alloc_.try_expand(static_cast<Unit<Size>*>(p), old_n, new_n);
+        } else {
+            (void)p; (void)old_n; (void)new_n;
+            return false;
+        }
+    }
+
+private:
+    Rebound alloc_;
+};
+
+template <typename Alloc>
+using UnitFactory = std::unique_ptr<UnitAllocatorBase> (*)(const Alloc&);
+
+template <typename Alloc, std::size_t... Kinds>
+constexpr std::array<UnitFactory<Alloc>, sizeof...(Kinds)>
+make_factories(std::index_sequence<Kinds...>) {
+    return {{[](const Alloc& root) -> std::unique_ptr<UnitAllocatorBase> {
+        return std::make_unique<UnitAllocator<Alloc, unit_size(Kinds)>>(root);
+    }...}};
+}
+
+template <typename Alloc>
+class Replayer {
+public:
+    void run(const std::vector<TraceRecord>& trace) {
+        for (const TraceRecord& rec : trace) {
+            switch (static_cast<TraceOp>(rec.op)) {
+                case TraceOp::Allocate: allocate(rec); break;
+                case TraceOp::Deallocate: deallocate(rec); break;
+                case TraceOp::Expand: expand(rec); break;
+                case TraceOp::PoolDestroyed: destroy_pool(rec.pool); break;
+            }
+        }
+        while (!pools_.empty()) {
+            destroy_pool(pools_.begin()->first);
+        }
+    }
+
+private:
+    struct Pool {
+        Alloc root;
+        std::array<std::unique_ptr<UnitAllocatorBase>, unit_kinds> units;
+    };
+
+    struct Live {
+        void* ptr;
+        std::uint32_t pool;
+        std::size_t kind;
+        std::size_t count;
+        std::size_t bytes;
+    };
+
+    static constexpr std::array<UnitFactory<Alloc>, unit_kinds> factories =
+        make_factories<Alloc>(std::make_index_sequence<unit_kinds>());
+
+    // Элементы крупнее max_unit_bytes - массивом 8-байтовых единиц
+    static std::pair<std::size_t, std::size_t> shape(std::size_t elem_size, std::size_t count) {
+        if (elem_size > max_unit_bytes) {
+            return {unit_kind(8), count * ((elem_size + 7) / 8)};
+        }
+        return {unit_kind(elem_size), count};
+    }
+
+    UnitAllocatorBase& unit(std::uint32_t pool_id, std::size_t kind) {
+        Pool& pool = pools_[pool_id];
+        auto& slot = pool.units[kind];
+        if (!slot) {
+            slot = factories[kind](pool.root);
+        }
+        return *slot;
+    }
+
+    void allocate(const TraceRecord& rec) {
+        auto [kind, count] = shape(rec.elem_size, rec.count);
+        void* p = unit(rec.pool, kind).allocate(count);
+        std::size_t bytes = std::size_t(rec.elem_size) * rec.count;
+        live_[rec.address] = {p, rec.pool, kind, count, bytes};
+        add_live(bytes);
+    }
+
+    void deallocate(const TraceRecord& rec) {
+        auto it = live_.find(rec.address);
+        if (it == live_.end()) return;
+        release(it->second);
+        live_.erase(it);
+    }
+
+    // Если конфигурация не умеет расти на месте - как realloc
+    void expand(const TraceRecord& rec) {
+        auto it = live_.find(rec.address);
+        if (it == live_.end()) return;
+        Live& live = it->second;
+        auto [kind, count] = shape(rec.elem_size, rec.count);
+        if (kind != live.kind || count <= live.count) return;
+
+        UnitAllocatorBase& alloc = unit(live.pool, kind);
+        std::size_t bytes = std::size_t(rec.elem_size) * rec.count;
+        if (!alloc.try_expand(live.ptr, live.count, count)) {
+            void* p = alloc.allocate(count);
+            std::memcpy(p, live.ptr, live.count * unit_size(kind));
+            alloc.deallocate(live.ptr, live.count);
+            live.ptr = p;
+        }
+        add_live(bytes - live.bytes);
+        live.count = count;
+        live.bytes = bytes;
+    }
+
+    void release(const Live& live) {
+        unit(live.pool, live.kind).deallocate(live.ptr, live.count);
+        meter.live -= live.bytes;
+    }
+
+    void destroy_pool(std::uint32_t pool_id) {
+        for (auto it = live_.begin(); it != live_.end();) {
+            if (it->second.pool == pool_id) {
+                release(it->second);
+                it = live_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        pools_.erase(pool_id);
+    }
+
+    static void add_live(std::size_t bytes) {
+        meter.live += bytes;
+        if (meter.live > meter.peak_live) {
+            meter.peak_live = meter.live;
+        }
+    }
+
+    std::unordered_map<std::uint32_t, Pool> pools_;
+    std::unordered_map<std::uint64_t, Live> live_;
+};
+
+template <typename Alloc>
+void replay(const std::string& name, const std::vector<TraceRecord>& trace) {
+    meter = MemoryMeter();
+    auto start = std::chrono::steady_clock::now();
+    Replayer<Alloc>().run(trace);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    double fragmentation = meter.peak_reserved
+        ? 1.0 - double(meter.peak_live) / double(meter.peak_reserved) : 0.0;
+
+    std::cout << std::left << std::setw(16) << name << std::right
+              << std::setw(12) << std::fixed << std::setprecision(2) << ms
+              << std::setw(16) << meter.peak_reserved
+              << std::setw(16) << meter.peak_live
+              << std::setw(14) << std::setprecision(1) << fragmentation * 100.0 << "%\n";
+}
+
+template <typename T, std::size_t ChunkElems, bool PerElementFree, typename Growth = FixedGrowth,
+          typename Slots = FreeListSlots>
+using ReplayAllocator = CustomAllocator<T, ChunkElems, true, PerElementFree, false,
+                                        NaturalAlign, MeteredBlockSource, LocalOwnership, Growth, Slots>;
+
+using Config = void (*)(const std::string&, const std::vector<TraceRecord>&);
+
+const std::pair<const char*, Config> configs[] = {
+    {"std", replay<MeteredStdAllocator<char>>},
+    {"pool-10", replay<ReplayAllocator<char, 10, false>>},
+    {"pool-256", replay<ReplayAllocator<char, 256, false>>},
+    {"free-10", replay<ReplayAllocator<char, 10, true>>},
+    {"free-256", replay<ReplayAllocator<char, 256, true>>},
+    {"free-geometric", replay<ReplayAllocator<char, 64, true, GeometricGrowth<>>>},
+    {"free-64k", replay<ReplayAllocator<char, 1, true, ByteTargetGrowth<>>>},
+    {"slab-256", replay<ReplayAllocator<char, 256, true, FixedGrowth, BitmapSlabs<>>>},
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <trace> [config...]\nconfigs:";
+        for (const auto& [name, run] : configs) {
+            std::cerr << ' ' << name;
+        }
+        std::cerr << '\n';
+        return 2;
+    }
+
+    try {
+        std::vector<TraceRecord> trace = read_trace(argv[1]);
+        std::cout << trace.size() << " events\n"
+                  << std::left << std::setw(16) << "config" << std::right
+                  << std::setw(12) << "time, ms"
+                  << std::setw(16) << "peak reserved"
+                  << std::setw(16) << "peak live"
+                  << std::setw(15) << "fragmentation\n";
+
+        for (const auto& [name, run] : configs) {
+            bool selected = argc == 2;
+            for (int i = 2; i < argc; ++i) {
+                selected = selected || std::strcmp(argv[i], name) == 0;
+            }
+            if (selected) {
+                run(name, trace);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
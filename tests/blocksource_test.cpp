@@ -0,0 +1,202 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <new>
+
+#include "customallocator.h"
+#include "blocksource.h"
+#include "testcheck.h"
+
+// Источники блоков: выравнивание выданной памяти, возврат через
+// deallocate и исчерпание. nullptr от источника пул превращает в bad_alloc.
+
+namespace {
+
+bool aligned(const void* p, std::size_t align) {
+    return reinterpret_cast<std::uintptr_t>(p) % align == 0;
+}
+
+// Выдать блоки разных размеров и выравниваний, заполнить их целиком,
+// проверить содержимое и вернуть в обратном порядке
+template <typename Source>
+void round_trip(Source& source, std::size_t max_align) {
+    struct Taken {
+        void* p;
+        std::size_t bytes;
+        std::size_t align;
+    };
+    Taken taken[64];
+    int count = 0;
+    for (std::size_t align = alignof(std::max_align_t); align <= max_align; align *= 2) {
+        for (std::size_t bytes : {std::size_t(1), std::size_t(100), std::size_t(4096), std::size_t(70000)}) {
+            void* p = source.allocate(bytes, align);
+            CHECK(p != nullptr);
+            CHECK(aligned(p, align));
+            std::memset(p, count + 1, bytes);
+            taken[count++] = {p, bytes, align};
+        }
+    }
+    while (count > 0) {
+        Taken& t = taken[--count];
+        const auto* bytes = static_cast<const unsigned char*>(t.p);
+        CHECK(bytes[0] == count + 1 && bytes[t.bytes - 1] == count + 1);
+        source.deallocate(t.p, t.bytes, t.align);
+    }
+}
+
+void new_source() {
+    NewBlockSource source;
+    round_trip(source, 4096);
+}
+
+void malloc_source() {
+    MallocBlockSource source;
+    round_trip(source, 4096);
+}
+
+void static_arena() {
+    alignas(64) static unsigned char buffer[1024];
+    StaticArena arena(buffer);
+    StaticBufferSource source(arena);
+
+    void* a = source.allocate(100, 16);
+    CHECK(a == buffer);
+    void* b = source.allocate(10, 64);
+    CHECK(b == buffer + 128);
+    CHECK(arena.used() == 138);
+
+    // Вернуть можно только последний блок; остальное - вместе с буфером
+    std::size_t used = arena.used();
+    source.deallocate(a, 100, 16);
+    CHECK(arena.used() == used);
+    // Отступ под выравнивание b остается занятым: a уже не последний
+    source.deallocate(b, 10, 64);
+    CHECK(arena.used() == 128);
+    source.deallocate(a, 100, 16);
+    CHECK(arena.used() == 128);
+
+    StaticArena fresh(buffer);
+    StaticBufferSource again(fresh);
+    a = again.allocate(100, 16);
+    again.deallocate(a, 100, 16);
+    CHECK(fresh.used() == 0);
+
+    // Исчерпание: nullptr, состояние арены не меняется
+    CHECK(again.allocate(1025, 16) == nullptr);
+    CHECK(again.allocate(1024, 16) == buffer);
+    CHECK(again.allocate(1, 1) == nullptr);
+    CHECK(fresh.used() == fresh.capacity());
+
+    StaticBufferSource detached;
+    CHECK(detached.allocate(16, 16) == nullptr);
+}
+
+// Пул на исчерпанном источнике бросает bad_alloc, а не пишет за буфер
+void static_exhaustion() {
+    alignas(64) static unsigned char buffer[2048];
+    StaticArena arena(buffer);
+    using Alloc = CustomAllocator<int, 16, true, true, false, NaturalAlign, StaticBufferSource>;
+    Alloc alloc{StaticBufferSource(arena)};
+
+    int allocated = 0;
+    bool thrown = false;
+    try {
+        for (; allocated < 10000; ++allocated) {
+            int* p = alloc.allocate(1);
+            *p = allocated;
+        }
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(allocated > 0);
+    CHECK(arena.used() <= arena.capacity());
+
+    Alloc detached{StaticBufferSource()};
+    thrown = false;
+    try {
+        (void)detached.allocate(1);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+// Блоки из вышестоящего пула: до max_align_t, сверх него - nullptr
+void allocator_source() {
+    using Upstream = CustomAllocator<char, 4096>;
+    Upstream upstream;
+    AllocatorBlockSource<Upstream> source(upstream);
+    round_trip(source, alignof(std::max_align_t));
+    CHECK(source.allocate(64, alignof(std::max_align_t) * 2) == nullptr);
+
+    // Нерасширяемый вышестоящий пул кончается: nullptr -> bad_alloc
+    using Fixed = CustomAllocator<char, 8192, false>;
+    using Alloc = CustomAllocator<std::pair<const int, int>, 64, true, true, false, NaturalAlign,
+                                  AllocatorBlockSource<Fixed>>;
+    Fixed fixed;
+    Alloc alloc{AllocatorBlockSource<Fixed>(fixed)};
+    bool thrown = false;
+    try {
+        std::map<int, int, std::less<int>, Alloc> m(alloc);
+        for (int i = 0; i < 100000; ++i) m.emplace(i, i);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+#ifdef BLOCKSOURCE_HAS_MMAP
+template <unsigned Flags>
+void mmap_source() {
+    MmapBlockSource<Flags> source;
+    std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    round_trip(source, std::size_t(1) << 16);
+
+    void* p = source.allocate(100, 16);
+    CHECK(p != nullptr && aligned(p, page));
+    source.deallocate(p, 100, 16);
+
+    if (Flags & MmapHugePages) {
+        std::size_t huge = MmapBlockSource<Flags>::huge_page_size;
+        void* h = source.allocate(huge, 16);
+        CHECK(h != nullptr && aligned(h, huge));
+        std::memset(h, 1, huge);
+        source.deallocate(h, huge, 16);
+    }
+}
+
+// purge_pages отдает только целые страницы, и они приходят обнуленными
+void purge() {
+    MmapBlockSource<> source;
+    std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto* p = static_cast<unsigned char*>(source.allocate(4 * page, page));
+    CHECK(p != nullptr);
+    std::memset(p, 7, 4 * page);
+
+    CHECK(purge_pages(p + 1, page) == 0);
+    CHECK(purge_pages(p + 1, 3 * page) == 2 * page);
+    CHECK(p[0] == 7 && p[page - 1] == 7);
+    CHECK(p[page] == 0 && p[3 * page - 1] == 0);
+    CHECK(p[3 * page] == 7);
+    source.deallocate(p, 4 * page, page);
+}
+#endif
+
+} // namespace
+
+int main() {
+    new_source();
+    malloc_source();
+    static_arena();
+    static_exhaustion();
+    allocator_source();
+#ifdef BLOCKSOURCE_HAS_MMAP
+    mmap_source<MmapDefault>();
+    mmap_source<MmapPrefault>();
+    mmap_source<MmapPrefault | MmapHugePages>();
+    purge();
+#endif
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+#include "customallocator.h"
+#include "pooldecay.h"
+#include "testcheck.h"
+
+// decay(): за окно idle_for возвращается только память, которая все окно
+// простояла (минимум idle_bytes() за окно). PoolDecayThread вызывает его
+// сам и останавливается при разрушении, не дожидаясь конца периода
+
+namespace {
+
+using Alloc = CustomAllocator<int, 1024>;
+using State = Alloc::State;
+using clock = std::chrono::steady_clock;
+using std::chrono::seconds;
+
+// Заполнить пул блоками и сбросить: все блоки за первым простаивают
+void fill_and_reset(Alloc& alloc, int blocks) {
+    for (int i = 0; i < blocks; ++i) (void)alloc.allocate(1000);
+    alloc.reset();
+}
+
+void whole_window_idle() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    fill_and_reset(alloc, 8);
+    std::size_t idle = pool->idle_bytes();
+    CHECK(idle > 0);
+
+    clock::time_point t0 = clock::now();
+    // Первый вызов только открывает окно
+    CHECK(pool->decay(seconds(1), TrimMode::Release, t0) == 0);
+    CHECK(pool->decay(seconds(1), TrimMode::Release, t0 + seconds(1) / 2) == 0);
+    CHECK(pool->idle_bytes() == idle);
+
+    std::size_t released = pool->decay(seconds(1), TrimMode::Release, t0 + seconds(1));
+    CHECK(released > 0);
+    CHECK(pool->idle_bytes() == 0);
+    CHECK(pool->block_count == 1);
+}
+
+// Блоки, понадобившиеся в окне, остаются; возвращается только хвост,
+// который окно простоял
+void partly_used_window() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    fill_and_reset(alloc, 8);
+    std::size_t blocks = pool->block_count;
+
+    clock::time_point t0 = clock::now();
+    CHECK(pool->decay(seconds(1), TrimMode::Release, t0) == 0);
+    // Нагрузка в окне занимает половину блоков
+    fill_and_reset(alloc, 4);
+
+    std::size_t released = pool->decay(seconds(1), TrimMode::Release, t0 + seconds(1));
+    CHECK(released > 0);
+    CHECK(pool->block_count > 1 && pool->block_count < blocks);
+    CHECK(pool->idle_bytes() > 0);
+
+    // Следующее окно без нагрузки возвращает и остальное
+    CHECK(pool->decay(seconds(1), TrimMode::Release, t0 + seconds(2)) > 0);
+    CHECK(pool->block_count == 1);
+}
+
+void background_thread() {
+    Alloc alloc;
+    std::mutex guard;
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        fill_and_reset(alloc, 8);
+    }
+
+    PoolDecayThread decay(std::chrono::milliseconds(1));
+    decay.watch(alloc, guard, std::chrono::milliseconds(1));
+    clock::time_point deadline = clock::now() + seconds(10);
+    while (decay.released() == 0 && clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(decay.released() > 0);
+    std::lock_guard<std::mutex> lock(guard);
+    CHECK(alloc.pool()->block_count == 1);
+}
+
+// Разрушение будит поток: час периода ждать не приходится
+void prompt_stop() {
+    clock::time_point start = clock::now();
+    {
+        Alloc alloc;
+        std::mutex guard;
+        PoolDecayThread decay(std::chrono::hours(1));
+        decay.watch(alloc, guard, std::chrono::hours(1));
+    }
+    CHECK(clock::now() - start < seconds(5));
+}
+
+} // namespace
+
+int main() {
+    whole_window_idle();
+    partly_used_window();
+    background_thread();
+    prompt_stop();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <cstddef>
+#include <new>
+
+#include "customallocator.h"
+#include "customvector.h"
+#include "testcheck.h"
+
+// Выделение с запасом и рост на месте у bump-указателя:
+// allocate_at_least и try_expand, на которых растет SimpleVector
+
+namespace {
+
+using Alloc = CustomAllocator<int, 1024>;
+using State = Alloc::State;
+
+// Запас - не больше еще n элементов и не больше остатка блока
+void at_least() {
+    Alloc alloc;
+    auto r = alloc.allocate_at_least(10);
+    CHECK(r.ptr != nullptr && r.count == 20);
+
+    // В блоке на 1024 элемента остается 1024 - 20 - 1000 = 4
+    int* filler = alloc.allocate(1000);
+    CHECK(filler == r.ptr + 20);
+    auto tail = alloc.allocate_at_least(3);
+    CHECK(tail.ptr == filler + 1000 && tail.count == 4);
+    alloc.deallocate(tail.ptr, tail.count);
+    alloc.deallocate(filler, 1000);
+    alloc.deallocate(r.ptr, r.count);
+
+    // Крупное выделение живет в своем блоке и запаса не получает
+    std::size_t big = State::min_large_bytes / sizeof(int) * 2;
+    auto large = alloc.allocate_at_least(big);
+    CHECK(alloc.pool()->find_large(large.ptr) != nullptr);
+    CHECK(large.count == big);
+    alloc.deallocate(large.ptr, large.count);
+}
+
+// В нерасширяемом пуле вектор не забирает весь блок: остальным
+// rebind'ам того же пула остается место
+void at_least_shared() {
+    using Fixed = CustomAllocator<int, 1024, false>;
+    Fixed alloc;
+    auto r = alloc.allocate_at_least(100);
+    CHECK(r.count == 200);
+
+    using Doubles = std::allocator_traits<Fixed>::rebind_alloc<double>;
+    Doubles other(alloc);
+    double* d = other.allocate(100);
+    CHECK(d != nullptr);
+    CHECK(alloc.pool()->owns(d));
+    other.deallocate(d, 100);
+    alloc.deallocate(r.ptr, r.count);
+}
+
+// SimpleVector запоминает реальную емкость из allocate_at_least
+void vector_capacity() {
+    Alloc alloc;
+    SimpleVector<int, Alloc> v(alloc);
+    v.PushBack(1);
+    CHECK(v.GetCapacity() == 2);
+}
+
+// Рост на месте: только последнее bump-выделение и только в пределах блока
+void expand() {
+    Alloc alloc;
+    int* p = alloc.allocate(10);
+    for (int i = 0; i < 10; ++i) p[i] = i;
+    CHECK(alloc.try_expand(p, 10, 20));
+    CHECK(p[9] == 9);
+    // bump-указатель сдвинулся за расширенное выделение
+    int* q = alloc.allocate(10);
+    CHECK(q == p + 20);
+
+    // p уже не последнее: расширение затерло бы q
+    q[0] = 42;
+    CHECK(!alloc.try_expand(p, 20, 30));
+    CHECK(q[0] == 42);
+
+    // Сжатие и тот же размер - отказ, bump-указатель на месте
+    CHECK(!alloc.try_expand(q, 10, 5));
+    CHECK(!alloc.try_expand(q, 10, 10));
+    int* r = alloc.allocate(4);
+    CHECK(r == q + 10);
+
+    // Больше, чем осталось в блоке на 1024 элемента, - отказ
+    CHECK(!alloc.try_expand(r, 4, 1024));
+    CHECK(alloc.try_expand(r, 4, 1024 - 30));
+    CHECK(alloc.pool()->current_offset == alloc.pool()->current_block->bytes);
+
+    alloc.deallocate(r, 1024 - 30);
+    alloc.deallocate(q, 10);
+    alloc.deallocate(p, 20);
+}
+
+// Вектор, который остается последним выделением, растет без переносов
+void vector_in_place() {
+    Alloc alloc;
+    SimpleVector<int, Alloc> v(alloc);
+    v.PushBack(0);
+    const int* data = v.begin();
+    for (int i = 1; i < 1000; ++i) v.PushBack(i);
+    CHECK(v.begin() == data);
+    CHECK(v.GetCapacity() >= 1000);
+    for (int i = 0; i < 1000; ++i) CHECK(v[i] == i);
+
+    // За вектором чужое выделение: следующий рост переносит элементы
+    int* other = alloc.allocate(1);
+    std::size_t capacity = v.GetCapacity();
+    while (v.GetSize() < capacity + 1) v.PushBack(7);
+    CHECK(v.begin() != data);
+    CHECK(v[999] == 999);
+    alloc.deallocate(other, 1);
+}
+
+} // namespace
+
+int main() {
+    at_least();
+    at_least_shared();
+    vector_capacity();
+    expand();
+    vector_in_place();
+    return 0;
+}
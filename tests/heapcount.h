@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Замена глобальных operator new/delete поверх malloc/free со счетчиком
+// обращений текущего потока: по нему бенчмарк и тесты видят, сколько раз
+// сценарий сходил в кучу. Подключать ровно в одну единицу трансляции
+// программы - замена глобальных операторов не может быть inline.
+
+inline thread_local std::size_t heap_allocations = 0;
+
+// GCC считает free для указателя из operator new ошибкой, хотя пара
+// здесь согласована
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t bytes) {
+    ++heap_allocations;
+    if (void* p = std::malloc(bytes ? bytes : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t bytes, std::align_val_t align) {
+    ++heap_allocations;
+    std::size_t a = static_cast<std::size_t>(align);
+#ifdef _WIN32
+    if (void* p = ::_aligned_malloc(bytes ? bytes : 1, a)) return p;
+#else
+    if (void* p = std::aligned_alloc(a, (bytes + a - 1) / a * a)) return p;
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+#ifdef _WIN32
+void operator delete(void* p, std::align_val_t) noexcept { ::_aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { ::_aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
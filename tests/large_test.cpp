@@ -0,0 +1,62 @@
+#include <cstddef>
+
+#include "customallocator.h"
+#include "customvector.h"
+#include "testcheck.h"
+
+// Крупные выделения: порог не зависит от малого ChunkElems, буферы ниже
+// порога растут на месте в арене, а deallocate узнает крупный блок по
+// индексу, даже если порог успел вырасти
+
+namespace {
+
+using Alloc = CustomAllocator<int>;
+using State = Alloc::State;
+
+void threshold() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    CHECK(pool->large_threshold(sizeof(int)) >= State::min_large_bytes);
+
+    // Вектор в тысячи элементов при ChunkElems = 10 живет в арене
+    int* p = alloc.allocate(1000);
+    CHECK(pool->find_large(p) == nullptr);
+    CHECK(pool->owns(p));
+    CHECK(alloc.try_expand(p, 1000, 1010));
+    alloc.deallocate(p, 1010);
+
+    SimpleVector<int, Alloc> v(alloc);
+    for (int i = 0; i < 10000; ++i) v.PushBack(i);
+    CHECK(pool->large_blocks == nullptr);
+    CHECK(pool->owns(v.begin()));
+}
+
+void threshold_grows() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    std::size_t n = State::min_large_bytes / sizeof(int) * 2;
+    int* big = alloc.allocate(n);
+    CHECK(pool->find_large(big) != nullptr);
+    std::size_t reserved = pool->reserved_bytes;
+
+    // Блок арены в 4 порога поднимает порог выше размера big
+    pool->reserve_bytes(State::min_large_bytes * 8);
+    CHECK(pool->large_threshold(sizeof(int)) > n * sizeof(int));
+    CHECK(!pool->is_large(n * sizeof(int), sizeof(int)));
+
+    std::size_t before = pool->reserved_bytes;
+    CHECK(before > reserved);
+    alloc.deallocate(big, n);
+    CHECK(pool->large_blocks == nullptr);
+    CHECK(pool->find_large(big) == nullptr);
+    CHECK(pool->reserved_bytes < before);
+    CHECK(pool->span_count == 0);
+}
+
+} // namespace
+
+int main() {
+    threshold();
+    threshold_grows();
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "customallocator.h"
+#include "lockfreestack.h"
+#include "testcheck.h"
+
+// Нагрузка на конкурентный пул из нескольких потоков: TaggedFreeStack
+// сам по себе и потокобезопасный CustomAllocator, в котором узлы
+// освобождает не тот поток, что их выделил. Имеет смысл прежде всего
+// под ThreadSanitizer (-DALLOCATOR_TSAN=ON).
+// pool_stress [rounds]
+
+namespace {
+
+constexpr int threads = 4;
+
+// Слот стека: next пишет сам стек, held - признак, что слот снят.
+// Слот, выданный двум потокам сразу (ABA), поймает exchange
+struct StackSlot {
+    void* next;
+    std::atomic<int> held;
+};
+
+void stack_stress(int rounds) {
+    constexpr int slots = 64;
+    std::vector<StackSlot> storage(slots);
+    TaggedFreeStack stack;
+    for (auto& s : storage) {
+        s.held.store(0);
+        stack.push(&s);
+    }
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            StackSlot* mine[4];
+            for (int r = 0; r < rounds; ++r) {
+                int taken = 0;
+                for (; taken < 4; ++taken) {
+                    auto* s = static_cast<StackSlot*>(stack.pop());
+                    if (!s) break;
+                    CHECK(s->held.exchange(1) == 0);
+                    mine[taken] = s;
+                }
+                while (taken > 0) {
+                    StackSlot* s = mine[--taken];
+                    s->held.store(0);
+                    stack.push(s);
+                }
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+
+    int count = 0;
+    while (stack.pop()) ++count;
+    CHECK(count == slots);
+}
+
+struct Payload {
+    std::uint64_t tag;
+    std::uint64_t check;
+    char fill[16];
+};
+
+using StressAlloc = CustomAllocator<Payload, 64, true, true, true>;
+
+// Производители выделяют и подписывают узлы, потребители проверяют
+// подпись и освобождают их; параллельно каждый поток гоняет свой список
+// и многоэлементные выделения в том же пуле
+void cross_thread_stress(int rounds) {
+    StressAlloc alloc;
+    std::mutex queue_mutex;
+    std::deque<Payload*> queue;
+    std::atomic<int> producers_left{threads / 2};
+    std::atomic<long> produced{0};
+    std::atomic<long> consumed{0};
+
+    auto producer = [&](std::uint64_t id) {
+        StressAlloc local(alloc);
+        using IntAlloc = std::allocator_traits<StressAlloc>::rebind_alloc<int>;
+        std::list<int, IntAlloc> l{IntAlloc(local)};
+        for (int r = 0; r < rounds; ++r) {
+            Payload* p = local.allocate(1);
+            p->tag = (id << 32) | static_cast<std::uint64_t>(r);
+            p->check = ~p->tag;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                queue.push_back(p);
+            }
+            ++produced;
+            l.push_back(r);
+            if (l.size() > 32) l.pop_front();
+        }
+        --producers_left;
+    };
+
+    auto consumer = [&] {
+        StressAlloc local(alloc);
+        for (;;) {
+            Payload* p = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                if (!queue.empty()) {
+                    p = queue.front();
+                    queue.pop_front();
+                }
+            }
+            if (!p) {
+                if (producers_left.load() == 0) {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    if (queue.empty()) break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            CHECK(p->check == ~p->tag);
+            local.deallocate(p, 1);
+            ++consumed;
+
+            Payload* span = local.allocate(3);
+            for (int i = 0; i < 3; ++i) span[i].tag = span[i].check = static_cast<std::uint64_t>(i);
+            for (int i = 0; i < 3; ++i) CHECK(span[i].tag == static_cast<std::uint64_t>(i));
+            local.deallocate(span, 3);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads / 2; ++t) {
+        pool.emplace_back(producer, static_cast<std::uint64_t>(t));
+        pool.emplace_back(consumer);
+    }
+    for (auto& th : pool) th.join();
+
+    CHECK(produced.load() == static_cast<long>(threads / 2) * rounds);
+    CHECK(consumed.load() == produced.load());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 20000;
+    stack_stress(rounds);
+    cross_thread_stress(rounds);
+    return 0;
+}
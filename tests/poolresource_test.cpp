@@ -0,0 +1,135 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+#include "customallocator.h"
+#include "customvector.h"
+#include "poolresource.h"
+#include "testcheck.h"
+
+// PoolResource: выделения не выходят за блок при любом chunk_bytes,
+// выравнивание соблюдается, освобожденное переиспользуется, а пул
+// CustomAllocator делится с pmr-контейнерами. Общий пул и у rebind'ов
+// самого CustomAllocator
+
+namespace {
+
+bool aligned(const void* p, std::size_t align) {
+    return reinterpret_cast<std::uintptr_t>(p) % align == 0;
+}
+
+// Самый крупный мелкий запрос с самым строгим выравниванием в блоке,
+// меньшем этого запроса: блок должен вырасти до него
+void small_chunk() {
+    for (std::size_t chunk : {std::size_t(1), std::size_t(1000), std::size_t(1024), std::size_t(1100)}) {
+        PoolResource<> r(chunk);
+        for (int i = 0; i < 4; ++i) {
+            void* p = r.allocate(PoolResource<>::max_small_bytes, PoolResource<>::max_small_align);
+            CHECK(aligned(p, PoolResource<>::max_small_align));
+            std::memset(p, i, PoolResource<>::max_small_bytes);
+        }
+    }
+}
+
+void reuse_and_align() {
+    PoolResource<> r(4096);
+    std::vector<void*> taken;
+    for (std::size_t align = 1; align <= 256; align *= 2) {
+        for (std::size_t bytes : {std::size_t(1), std::size_t(24), std::size_t(1000), std::size_t(5000)}) {
+            void* p = r.allocate(bytes, align);
+            CHECK(aligned(p, align));
+            std::memset(p, 1, bytes);
+            r.deallocate(p, bytes, align);
+            CHECK(r.allocate(bytes, align) == p || bytes > PoolResource<>::max_small_bytes ||
+                  align > PoolResource<>::max_small_align);
+        }
+    }
+    r.release();
+}
+
+// pmr-контейнеры и контейнеры с CustomAllocator в одной арене: узлы одного
+// размера переиспользуют слоты друг друга, ничего не берется мимо пула
+void shared_pool() {
+    using Alloc = CustomAllocator<std::pair<const int, int>, 256, true, true>;
+    Alloc alloc;
+    PoolResource<Alloc::State> resource(*alloc.pool());
+    {
+        std::map<int, int, std::less<int>, Alloc> m(alloc);
+        std::pmr::map<int, int> pm(&resource);
+        std::pmr::vector<long> v(&resource);
+        SimpleVector<int, std::pmr::polymorphic_allocator<int>> sv(&resource);
+        for (int i = 0; i < 5000; ++i) {
+            m.emplace(i, i);
+            pm.emplace(i, i);
+            v.push_back(i);
+            sv.PushBack(i);
+        }
+        CHECK(alloc.pool()->owns(&*pm.begin()));
+        CHECK(alloc.pool()->owns(v.data()));
+        CHECK(alloc.pool()->owns(sv.begin()));
+
+        // Освобожденные pmr-узлы достаются CustomAllocator того же размера
+        const void* node = &*pm.find(42);
+        pm.erase(42);
+        m.erase(0);
+        m.emplace(-1, -1);
+        m.emplace(-2, -2);
+        CHECK(&*m.find(-1) == node || &*m.find(-2) == node);
+    }
+
+    PoolResource<Alloc::State> other(*alloc.pool());
+    CHECK(resource == other);
+    PoolResource<> separate;
+    CHECK(!(resource == separate));
+}
+
+// BitmapSlabs: мелкие запросы ресурса идут в slab'ы пула
+void slab_pool() {
+    using State = PoolState<false, NaturalAlign, NewBlockSource, FixedGrowth, BitmapSlabs<>>;
+    PoolResource<State> r(4096);
+    std::pmr::map<int, int> m(&r);
+    for (int i = 0; i < 10000; ++i) m.emplace(i, i);
+    for (int i = 0; i < 10000; ++i) CHECK(m.at(i) == i);
+}
+
+// Все rebind'ы аллокатора - один PoolState: узлы map берутся из пула
+// внешнего аллокатора, и reserve_elements резервирует под узел
+void rebind_shared() {
+    using Node = std::pair<const int, int>;
+    using Alloc = CustomAllocator<Node, 64>;
+    Alloc alloc;
+    using Chars = std::allocator_traits<Alloc>::rebind_alloc<char>;
+    Chars chars(alloc);
+    CHECK(chars.pool() == alloc.pool());
+    CHECK(chars == alloc);
+    CHECK(Alloc(chars) == alloc);
+    CHECK(Alloc() != alloc);
+
+    std::map<int, int, std::less<int>, Alloc> m(alloc);
+    m.emplace(0, 0);
+    CHECK(m.get_allocator().pool() == alloc.pool());
+    CHECK(alloc.pool()->owns(&*m.begin()));
+
+    // Слот узла map крупнее самой пары: под него и резервируется место
+    auto* pool = alloc.pool();
+    CHECK(pool->largest_slot > sizeof(Node));
+    alloc.reserve_elements(10000);
+    CHECK(pool->free_bytes >= 10000 * pool->largest_slot);
+    std::size_t blocks = pool->block_count;
+    for (int i = 1; i < 10000; ++i) m.emplace(i, i);
+    CHECK(pool->block_count == blocks);
+}
+
+} // namespace
+
+int main() {
+    small_chunk();
+    reuse_and_align();
+    shared_pool();
+    slab_pool();
+    rebind_shared();
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <cstddef>
+#include <map>
+
+#include "customallocator.h"
+#include "testcheck.h"
+
+// reset(): пул начинается заново на своих же блоках, без обращений к
+// источнику; крупные блоки возвращаются, свободные списки очищаются.
+// checkpoint()/rollback() и PoolScope - то же для всего, что выделено
+// после отметки
+
+namespace {
+
+using Alloc = CustomAllocator<int, 1024, true, true>;
+using State = Alloc::State;
+
+void reuse_blocks() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    int* first = alloc.allocate(100);
+    for (int i = 0; i < 10; ++i) (void)alloc.allocate(1000);
+    std::size_t blocks = pool->block_count;
+    std::size_t reserved = pool->reserved_bytes;
+    CHECK(blocks > 1);
+
+    alloc.reset();
+    CHECK(pool->current_block == pool->first_block);
+    CHECK(pool->free_bytes == pool->capacity_bytes);
+
+    // Тот же объем снова помещается в те же блоки
+    CHECK(alloc.allocate(100) == first);
+    for (int i = 0; i < 10; ++i) (void)alloc.allocate(1000);
+    CHECK(pool->block_count == blocks);
+    CHECK(pool->reserved_bytes == reserved);
+}
+
+void release_large() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    std::size_t reserved = pool->reserved_bytes;
+    int* big = alloc.allocate(State::min_large_bytes / sizeof(int) * 2);
+    CHECK(pool->find_large(big) != nullptr);
+    alloc.reset();
+    CHECK(pool->large_blocks == nullptr);
+    CHECK(pool->find_large(big) == nullptr);
+    CHECK(pool->reserved_bytes == reserved);
+}
+
+// Слот, освобожденный до reset(), не выдается снова поверх новых данных
+void clear_free_lists() {
+    Alloc alloc;
+    int* a = alloc.allocate(1);
+    int* b = alloc.allocate(1);
+    alloc.deallocate(b, 1);
+    alloc.reset();
+    int* c = alloc.allocate(1);
+    CHECK(c == a);
+    int* d = alloc.allocate(1);
+    CHECK(d == b);
+    int* e = alloc.allocate(1);
+    CHECK(e != b && e != c);
+}
+
+// Контейнеры между запросами: результаты не перемешиваются
+void per_request() {
+    using Node = std::pair<const int, int>;
+    using MapAlloc = CustomAllocator<Node, 256, true, true>;
+    MapAlloc alloc;
+    std::size_t blocks = 0;
+    for (int request = 0; request < 5; ++request) {
+        {
+            std::map<int, int, std::less<int>, MapAlloc> m(alloc);
+            for (int i = 0; i < 1000; ++i) m.emplace(i, i * request);
+            int sum = 0;
+            for (const auto& kv : m) sum += kv.second - kv.first * request;
+            CHECK(sum == 0);
+        }
+        alloc.reset();
+        if (request == 0) blocks = alloc.pool()->block_count;
+        CHECK(alloc.pool()->block_count == blocks);
+    }
+}
+
+// Вложенные области: внутренняя отбрасывает только свое
+void nested_scopes() {
+    Alloc alloc;
+    int* before = alloc.allocate(10);
+    int* outer_data = nullptr;
+    int* inner_data = nullptr;
+    {
+        PoolScope<Alloc> outer(alloc);
+        outer_data = alloc.allocate(10);
+        for (int i = 0; i < 10; ++i) outer_data[i] = i;
+        {
+            PoolScope<Alloc> inner(alloc);
+            inner_data = alloc.allocate(10);
+            for (int i = 0; i < 10; ++i) inner_data[i] = -1;
+        }
+        // Место внутренней области выдается снова, данные внешней целы
+        CHECK(alloc.allocate(10) == inner_data);
+        for (int i = 0; i < 10; ++i) CHECK(outer_data[i] == i);
+    }
+    CHECK(before + 10 == outer_data);
+    CHECK(alloc.allocate(10) == outer_data);
+}
+
+// Откат через границу блока: добавленные после отметки блоки остаются
+// в пуле и снова заполняются без обращений к источнику
+void rollback_across_blocks() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    (void)alloc.allocate(1000);
+    auto marker = alloc.checkpoint();
+    int* after = alloc.allocate(20);
+    for (int i = 0; i < 10; ++i) (void)alloc.allocate(1000);
+    std::size_t blocks = pool->block_count;
+    std::size_t reserved = pool->reserved_bytes;
+    CHECK(pool->current_block != marker.block);
+
+    alloc.rollback(marker);
+    CHECK(pool->current_block == marker.block);
+    CHECK(alloc.allocate(20) == after);
+    for (int i = 0; i < 10; ++i) (void)alloc.allocate(1000);
+    CHECK(pool->block_count == blocks);
+    CHECK(pool->reserved_bytes == reserved);
+}
+
+// Крупные блоки после отметки возвращаются источнику, до нее - остаются
+void rollback_large() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    std::size_t big = State::min_large_bytes / sizeof(int) * 2;
+    int* kept = alloc.allocate(big);
+    std::size_t reserved = pool->reserved_bytes;
+    {
+        PoolScope<Alloc> scope(alloc);
+        int* dropped = alloc.allocate(big);
+        CHECK(pool->find_large(dropped) != nullptr);
+        CHECK(pool->reserved_bytes > reserved);
+    }
+    CHECK(pool->reserved_bytes == reserved);
+    CHECK(pool->find_large(kept) != nullptr);
+    kept[big - 1] = 1;
+    alloc.deallocate(kept, big);
+    CHECK(pool->large_blocks == nullptr);
+}
+
+// Память, выданная после отката, принадлежит пулу: deallocate с
+// отладочной проверкой owns() ее принимает, в том числе в блоках,
+// добавленных после отметки
+void owns_after_rollback() {
+    Alloc alloc;
+    State* pool = alloc.pool();
+    auto marker = alloc.checkpoint();
+    for (int i = 0; i < 5; ++i) (void)alloc.allocate(1000);
+    alloc.rollback(marker);
+
+    int* spans[5];
+    for (int*& p : spans) {
+        p = alloc.allocate(1000);
+        CHECK(pool->owns(p));
+        CHECK(pool->owns(p + 999));
+    }
+    int* slot = alloc.allocate(1);
+    CHECK(pool->owns(slot));
+    alloc.deallocate(slot, 1);
+    for (int* p : spans) alloc.deallocate(p, 1000);
+
+    int local = 0;
+    CHECK(!pool->owns(&local));
+}
+
+} // namespace
+
+int main() {
+    reuse_blocks();
+    release_large();
+    clear_free_lists();
+    per_request();
+    nested_scopes();
+    rollback_across_blocks();
+    rollback_large();
+    owns_after_rollback();
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <map>
+#include <new>
+
+#include "customallocator.h"
+#include "testcheck.h"
+
+// BitmapSlabs без Expandable: у каждого размера слота один slab, как
+// один блок у арены со свободными списками; освобожденные слоты
+// переиспользуются, сверх slab'а - bad_alloc
+
+namespace {
+
+using Node = std::pair<const int, int>;
+using Alloc = CustomAllocator<Node, 10, false, true, false, NaturalAlign, NewBlockSource,
+                              SharedOwnership, FixedGrowth, BitmapSlabs<>>;
+
+void fixed_slab() {
+    Alloc alloc;
+    std::map<int, int, std::less<int>, Alloc> m(alloc);
+    int inserted = 0;
+    bool thrown = false;
+    try {
+        for (; inserted < 100000; ++inserted) m.emplace(inserted, inserted);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(inserted >= 10);
+    CHECK(alloc.pool()->reserved_bytes == alloc.pool()->slab_bytes(alloc.pool()->largest_slot));
+
+    // Освобожденный слот снова доступен
+    m.erase(0);
+    m.emplace(-1, -1);
+    CHECK(m.size() == static_cast<std::size_t>(inserted));
+}
+
+} // namespace
+
+int main() {
+    fixed_slab();
+    return 0;
+}
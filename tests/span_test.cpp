@@ -0,0 +1,109 @@
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+#include "customallocator.h"
+#include "testcheck.h"
+
+// Корзины span'ов: остатки блоков и освобожденные многоэлементные
+// выделения, поиск в них и переход к старшим классам
+
+namespace {
+
+// Освобожденный многоэлементный span выдается снова: целиком и по частям
+void reuse() {
+    CustomAllocator<int, 1024> alloc;
+    int* p = alloc.allocate(100);
+    (void)alloc.allocate(10);
+    alloc.deallocate(p, 100);
+    CHECK(alloc.allocate(100) == p);
+
+    alloc.deallocate(p, 100);
+    int* head = alloc.allocate(60);
+    CHECK(head == p);
+    // Остаток вернулся в корзину и достается следующему запросу
+    CHECK(alloc.allocate(40) == p + 60);
+    CHECK(alloc.pool()->span_count == 0);
+}
+
+// Пустые и слишком мелкие классы пропускаются по маске: запрос берет
+// верхний span ближайшего непустого старшего класса
+void mask_skip() {
+    using State = PoolState<>;
+    State pool(64);
+    alignas(64) static unsigned char buffer[4096];
+
+    unsigned char* small = buffer;
+    unsigned char* big = buffer + 1024;
+    CHECK(pool.push_span(small, 40));
+    CHECK(pool.push_span(big, 1024));
+    CHECK(pool.span_mask == ((std::uint64_t(1) << 5) | (std::uint64_t(1) << 10)));
+
+    // 200 байт - класс 7: класс 5 меньше, 6-9 пусты
+    CHECK(pool.pop_span(200, 8) == big);
+    // Остаток 824 байт - в классе 9, короткий span не тронут
+    CHECK(pool.span_mask == ((std::uint64_t(1) << 5) | (std::uint64_t(1) << 9)));
+    CHECK(pool.span_bins[9] == big + 200);
+    CHECK(pool.span_bins[5] == small);
+
+    // Ни один span не вмещает запрос
+    CHECK(pool.pop_span(2048, 8) == nullptr);
+    CHECK(pool.span_count == 2);
+}
+
+// Остаток блока короче узла не оседает в классе узла: иначе каждое
+// выделение узла перебирало бы все такие остатки
+void dead_tails() {
+    using Node = std::pair<const long, long>;
+    using Alloc = CustomAllocator<Node, 1024, true, true, false, NaturalAlign, NewBlockSource,
+                                  SharedOwnership, ByteTargetGrowth<4096>>;
+    using State = Alloc::State;
+    Alloc alloc;
+    std::map<long, long, std::less<long>, Alloc> m(alloc);
+    for (long i = 0; i < 100000; ++i) m.emplace(i, i);
+
+    State* pool = alloc.pool();
+    CHECK(pool->block_count > 100);
+    std::size_t own = State::span_class(pool->largest_slot);
+    CHECK(pool->span_bins[own] == nullptr);
+}
+
+// Свой класс проверяется лишь на span_probes span'ов от верхнего:
+// подходящий span глубже не ищется, запрос уходит в старший класс
+void bounded_probe() {
+    using State = PoolState<>;
+    State pool(64);
+    alignas(64) static unsigned char buffer[4096];
+
+    // Класс 6 (64..127 байт): снизу подходящий span, над ним короткие
+    unsigned char* deep = buffer;
+    CHECK(pool.push_span(deep, 127));
+    for (std::size_t i = 0; i < State::span_probes; ++i) {
+        CHECK(pool.push_span(buffer + 128 * (i + 1), 64));
+    }
+    unsigned char* wide = buffer + 2048;
+    CHECK(pool.push_span(wide, 256));
+
+    CHECK(pool.pop_span(120, 8) == wide);
+    // Короткие span'ы остались на месте, подходящий - под ними
+    CHECK(pool.span_bins[State::span_class(64)] == buffer + 128 * State::span_probes);
+
+    // Одним span'ом короче - подходящий попадает в пробы
+    pool.clear_free();
+    CHECK(pool.push_span(deep, 127));
+    for (std::size_t i = 0; i + 1 < State::span_probes; ++i) {
+        CHECK(pool.push_span(buffer + 128 * (i + 1), 64));
+    }
+    CHECK(pool.push_span(wide, 256));
+    CHECK(pool.pop_span(120, 8) == deep);
+}
+
+} // namespace
+
+int main() {
+    reuse();
+    mask_skip();
+    dead_tails();
+    bounded_probe();
+    return 0;
+}
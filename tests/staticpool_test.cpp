@@ -0,0 +1,94 @@
+#include <array>
+#include <cstddef>
+#include <map>
+#include <new>
+
+#include "heapcount.h"
+#include "staticpool.h"
+#include "testcheck.h"
+
+// FixedPool и StaticPool не обращаются к куче: ни при создании пула и
+// контейнера, ни при выделениях. Емкость в элементах ограничена буфером
+
+namespace {
+
+using Node = std::pair<const int, int>;
+
+template <typename Alloc>
+void churn(const Alloc& alloc, int n) {
+    std::map<int, int, std::less<int>, Alloc> m(alloc);
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < n; ++i) m.emplace(i, i);
+        CHECK(m.size() == static_cast<std::size_t>(n));
+        for (int i = 0; i < n; ++i) m.erase(i);
+    }
+}
+
+void static_pool() {
+    std::size_t before = heap_allocations;
+    {
+        static StaticPool<Node, 1 << 16, true> pool;
+        churn(pool.allocator(), 1000);
+    }
+    CHECK(heap_allocations == before);
+}
+
+void fixed_pool() {
+    alignas(64) static unsigned char buffer[1 << 16];
+    std::size_t before = heap_allocations;
+    {
+        FixedPool<Node, true> pool(buffer);
+        churn(pool.allocator(), 1000);
+    }
+    CHECK(heap_allocations == before);
+}
+
+// Без PerElementFree память не переиспользуется: буфер кончается
+// bad_alloc'ом, и тоже без обращения к куче
+void exhaustion() {
+    alignas(64) static unsigned char buffer[4096];
+    std::size_t before = heap_allocations;
+    bool thrown = false;
+    {
+        FixedPool<Node> pool(buffer);
+        try {
+            churn(pool.allocator(), 1000);
+        } catch (const std::bad_alloc&) {
+            thrown = true;
+        }
+    }
+    CHECK(thrown);
+    CHECK(heap_allocations == before);
+}
+
+// Емкость пула в элементах T, а не в байтах буфера
+void capacity() {
+    std::array<std::byte, 4096> buffer;
+    FixedPool<int> pool(buffer);
+    auto alloc = pool.allocator();
+    std::size_t elems = pool.capacity() / sizeof(int);
+    CHECK(elems > 0 && elems < buffer.size());
+
+    bool thrown = false;
+    try {
+        (void)alloc.allocate(elems + 1);
+    } catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    int* p = alloc.allocate(elems);
+    p[0] = 1;
+    p[elems - 1] = 2;
+    alloc.deallocate(p, elems);
+}
+
+} // namespace
+
+int main() {
+    static_pool();
+    fixed_pool();
+    exhaustion();
+    capacity();
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <cstddef>
+#include <map>
+
+#include "customallocator.h"
+#include "testcheck.h"
+
+// trim(): Release после Purge возвращает источнику и отданные ядру
+// блоки, но в освобожденные байты их повторно не записывает
+
+namespace {
+
+#ifdef BLOCKSOURCE_HAS_MMAP
+using Node = std::pair<const int, int>;
+using Arena = CustomAllocator<Node, 1024, true, false, false, NaturalAlign, MmapBlockSource<>>;
+using Slabs = CustomAllocator<Node, 1024, true, true, false, NaturalAlign, MmapBlockSource<>,
+                              SharedOwnership, FixedGrowth, BitmapSlabs<>>;
+
+// Всплеск на n узлов, затем reset(): блоки и slab'ы остаются в пуле
+template <typename Alloc>
+void spike(Alloc& alloc, int n) {
+    {
+        std::map<int, int, std::less<int>, Alloc> m(alloc);
+        for (int i = 0; i < n; ++i) m.emplace(i, i);
+    }
+    alloc.reset();
+}
+
+void arena() {
+    Arena whole;
+    spike(whole, 100000);
+    std::size_t released = whole.trim(0, TrimMode::Release);
+    CHECK(released > 0);
+    CHECK(whole.trim(0, TrimMode::Release) == 0);
+
+    Arena purged;
+    spike(purged, 100000);
+    CHECK(purged.trim(0, TrimMode::Purge) > 0);
+    CHECK(purged.trim(0, TrimMode::Purge) == 0);
+    CHECK(purged.trim(0, TrimMode::Release) == 0);
+
+    // Purge только хвоста: Release считает лишь не отданные ядру блоки
+    Arena part;
+    spike(part, 100000);
+    CHECK(part.trim(released / 2, TrimMode::Purge) > 0);
+    std::size_t rest = part.trim(0, TrimMode::Release);
+    CHECK(rest > 0 && rest < released);
+}
+
+void slabs() {
+    Slabs alloc;
+    spike(alloc, 100000);
+    CHECK(alloc.trim(0, TrimMode::Purge) > 0);
+    CHECK(alloc.trim(0, TrimMode::Release) == 0);
+    CHECK(alloc.pool()->idle_bytes() == 0);
+}
+#endif
+
+} // namespace
+
+int main() {
+#ifdef BLOCKSOURCE_HAS_MMAP
+    arena();
+    slabs();
+#endif
+    return 0;
+}